@@ -0,0 +1,399 @@
+/*
+ *	Small serial protocol benchmarks
+ *
+ *
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "ssp.h"
+#include "ssp.c"
+
+#define BENCH_ITERATIONS		(20000)
+#define BENCH_PAYLOAD_SIZE		(48)
+#define BENCH_QUEUE_MESSAGES	(20000)
+#define BENCH_QUEUE_PRODUCERS	(8)
+#define BENCH_QUEUE_BLOCKS		(256)
+#define BENCH_WIRE_SIZE			(4096)
+#define BENCH_DUPLEX_BYTES		(200000)
+
+static volatile uint8_t bench_sink;
+
+static uint8_t BENCH_DallasCRC8_(uint8_t inbyte, uint8_t crc)
+{
+	for ( uint8_t j = 0; j < 8; ++j ){
+		uint8_t mix = (crc ^ inbyte) & 0x01;
+		crc >>= 1;
+		if ( mix ) crc ^= 0x8C;
+		inbyte >>= 1;
+	}
+	return crc;
+}
+
+static double BENCH_Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static uint32_t bench_random = 0x12345678;
+
+static uint8_t BENCH_Random(void)
+{
+	bench_random ^= bench_random << 13;
+	bench_random ^= bench_random >> 17;
+	bench_random ^= bench_random << 5;
+	return (uint8_t)bench_random;
+}
+
+// In memory wire between two links, one reader and one writer thread.
+// Indexes run free, size divides their range.
+static struct {
+	uint8_t data[BENCH_WIRE_SIZE];
+	uint16_t head;
+	uint16_t tail;
+}bench_wire[2];
+
+static bool BENCH_WireGet(uint8_t wire, uint8_t* value)
+{
+	uint16_t head = bench_wire[wire].head;
+	if(head == AtomicLoad(&bench_wire[wire].tail)) { return false; }
+	*value = bench_wire[wire].data[head % BENCH_WIRE_SIZE];
+	AtomicStore(&bench_wire[wire].head, (uint16_t)(head + 1));
+	return true;
+}
+
+static bool BENCH_WirePut(uint8_t wire, uint8_t value)
+{
+	uint16_t tail = bench_wire[wire].tail;
+	if((uint16_t)(tail - AtomicLoad(&bench_wire[wire].head)) == BENCH_WIRE_SIZE) { return false; }
+	bench_wire[wire].data[tail % BENCH_WIRE_SIZE] = value;
+	AtomicStore(&bench_wire[wire].tail, (uint16_t)(tail + 1));
+	return true;
+}
+
+static bool BENCH_A_GetByte(uint8_t* value){ return BENCH_WireGet(1, value); }
+static bool BENCH_A_PutByte(uint8_t value){ return BENCH_WirePut(0, value); }
+static bool BENCH_B_GetByte(uint8_t* value){ return BENCH_WireGet(0, value); }
+static bool BENCH_B_PutByte(uint8_t value){ return BENCH_WirePut(1, value); }
+static bool BENCH_NoInput(uint8_t* value){ (void)value; return false; }
+static bool BENCH_NoOutput(uint8_t value){ (void)value; return true; }
+
+// Message - [PRODUCER] [SEQUENCE 0..3], checked for order per producer
+static uint32_t bench_queue_expected[BENCH_QUEUE_PRODUCERS];
+static uint32_t bench_queue_received;
+static uint32_t bench_queue_errors;
+
+static bool BENCH_QueuePutRecord(const uint8_t* data, uint8_t size)
+{
+	uint32_t sequence;
+	memcpy(&sequence, &data[1], sizeof(sequence));
+	
+	if((size != 1 + sizeof(sequence))
+	or(data[0] >= BENCH_QUEUE_PRODUCERS)
+	or(sequence != bench_queue_expected[data[0]])) { bench_queue_errors++; }
+	else { bench_queue_expected[data[0]]++; }
+	
+	bench_queue_received++;
+	return true;
+}
+
+// Drained messages taken out of aggregation at once, no frames or wire.
+// Idle consumer yields, or on one core it spins out producers time.
+static void BENCH_DrainRecords(ssp_str* ssp)
+{
+	DrainQueue_(ssp);
+	if(ssp->aggregation.size == 0) { sched_yield(); return; }
+	
+	const uint8_t* records = Block_(ssp, ssp->aggregation.data);
+	for(uint8_t i = 0; i < ssp->aggregation.size; i += RECORD_HEADER_SIZE + records[i]){
+		BENCH_QueuePutRecord(&records[i + RECORD_HEADER_SIZE], records[i]);
+	}
+	ssp->aggregation.size = 0;
+	ssp->aggregation.encoded_size = 0;
+	GiveBlock_(ssp, &ssp->aggregation.data);
+}
+
+typedef struct {
+	ssp_str* ssp;
+	uint8_t id;
+}bench_producer_str;
+
+static void* BENCH_Producer(void* arg)
+{
+	const bench_producer_str* producer = arg;
+	uint8_t message[1 + sizeof(uint32_t)] = { producer->id };
+	
+	for(uint32_t sequence = 0; sequence < BENCH_QUEUE_MESSAGES; sequence++){
+		memcpy(&message[1], &sequence, sizeof(sequence));
+		while(not SPP_Enqueue(producer->ssp, message, sizeof(message))) { sched_yield(); }
+	}
+	return NULL;
+}
+
+void bench_queue(uint8_t producers_count, bool is_wire, long cores)
+{
+	static uint8_t blocks[BENCH_QUEUE_BLOCKS][POOL_BLOCK_SIZE];
+	static uint16_t next[BENCH_QUEUE_BLOCKS];
+	static ssp_pool_str pool;
+	static ssp_str sender;
+	static ssp_str receiver;
+	
+	memset(bench_wire, 0, sizeof(bench_wire));
+	memset(bench_queue_expected, 0, sizeof(bench_queue_expected));
+	bench_queue_received = 0;
+	bench_queue_errors = 0;
+	SPP_PoolInit(&pool, blocks, next, BENCH_QUEUE_BLOCKS);
+	
+	ssp_init_str config = { 0 };
+	config.CRC8_Function = BENCH_DallasCRC8_;
+	config.UART_GetByte_ = BENCH_A_GetByte;
+	config.UART_PutByte_ = BENCH_A_PutByte;
+	config.INPUT_GetByte_ = BENCH_NoInput;
+	config.OUTPUT_PutByte_ = BENCH_NoOutput;
+	config.framing = SSP_FRAMING_COBS;
+	config.check_type = SSP_CHECK_CRC16;
+	config.aggregation = true;
+	config.OUTPUT_PutRecord_ = BENCH_QueuePutRecord;
+	config.pool = &pool;
+	SPP_Init(&sender, &config);
+	
+	config.UART_GetByte_ = BENCH_B_GetByte;
+	config.UART_PutByte_ = BENCH_B_PutByte;
+	SPP_Init(&receiver, &config);
+	
+	pthread_t threads[BENCH_QUEUE_PRODUCERS];
+	bench_producer_str producers[BENCH_QUEUE_PRODUCERS];
+	const uint32_t total = (uint32_t)producers_count * BENCH_QUEUE_MESSAGES;
+	
+	// Handler thread alone frames, producers only enqueue. Over the wire
+	// rate is bounded by the handler moving bytes one per call, drain only
+	// run shows SPP_Enqueue contention and drain throughput.
+	double start = BENCH_Now();
+	for(uint8_t i = 0; i < producers_count; i++){
+		producers[i] = (bench_producer_str){ &sender, i };
+		pthread_create(&threads[i], NULL, BENCH_Producer, &producers[i]);
+	}
+	while(bench_queue_received < total){
+		if(not is_wire) { BENCH_DrainRecords(&sender); }
+		else {
+			SPP_Handler(&sender);
+			SPP_Handler(&receiver);
+		}
+	}
+	double elapsed = BENCH_Now() - start;
+	for(uint8_t i = 0; i < producers_count; i++){ pthread_join(threads[i], NULL); }
+	
+	printf("queue %-5s %u producers %ld cores %5.2f Mmsg/s, %8.1f ns/msg, order errors %u\n",
+		   is_wire? "wire" : "drain", producers_count, cores, total / elapsed * 1e3, elapsed / total, 
+		   bench_queue_errors);
+}
+
+// Byte stream each way - [0] [1] .. [255] [0] ..
+static uint32_t bench_duplex_sent[2];
+static uint32_t bench_duplex_received[2];
+static uint32_t bench_duplex_errors;
+static bool bench_duplex_done;
+
+static bool BENCH_DuplexInput(uint8_t side, uint8_t* value)
+{
+	if(bench_duplex_sent[side] == BENCH_DUPLEX_BYTES) { return false; }
+	*value = (uint8_t)bench_duplex_sent[side]++;
+	return true;
+}
+
+static bool BENCH_DuplexOutput(uint8_t side, uint8_t value)
+{
+	if(value != (uint8_t)bench_duplex_received[side]) { bench_duplex_errors++; }
+	AtomicStore(&bench_duplex_received[side], bench_duplex_received[side] + 1);
+	return true;
+}
+
+static bool BENCH_A_Input(uint8_t* value){ return BENCH_DuplexInput(0, value); }
+static bool BENCH_B_Input(uint8_t* value){ return BENCH_DuplexInput(1, value); }
+static bool BENCH_A_Output(uint8_t value){ return BENCH_DuplexOutput(1, value); }
+static bool BENCH_B_Output(uint8_t value){ return BENCH_DuplexOutput(0, value); }
+
+static void* BENCH_RxThread(void* arg)
+{
+	while(not AtomicLoad(&bench_duplex_done)) { SPP_RxHandler(arg); sched_yield(); }
+	return NULL;
+}
+
+static void* BENCH_TxThread(void* arg)
+{
+	while(not AtomicLoad(&bench_duplex_done)) { SPP_TxHandler(arg); sched_yield(); }
+	return NULL;
+}
+
+void bench_duplex(void)
+{
+	static ssp_str a;
+	static ssp_str b;
+	
+	memset(bench_wire, 0, sizeof(bench_wire));
+	
+	ssp_init_str config = { 0 };
+	config.CRC8_Function = BENCH_DallasCRC8_;
+	config.UART_GetByte_ = BENCH_A_GetByte;
+	config.UART_PutByte_ = BENCH_A_PutByte;
+	config.INPUT_GetByte_ = BENCH_A_Input;
+	config.OUTPUT_PutByte_ = BENCH_A_Output;
+	config.framing = SSP_FRAMING_COBS;
+	config.check_type = SSP_CHECK_CRC16;
+	SPP_Init(&a, &config);
+	
+	config.UART_GetByte_ = BENCH_B_GetByte;
+	config.UART_PutByte_ = BENCH_B_PutByte;
+	config.INPUT_GetByte_ = BENCH_B_Input;
+	config.OUTPUT_PutByte_ = BENCH_B_Output;
+	SPP_Init(&b, &config);
+	
+	// Every half of both links in its own thread. Yield lets them
+	// take turns when there are fewer cores than threads.
+	pthread_t threads[4];
+	double start = BENCH_Now();
+	pthread_create(&threads[0], NULL, BENCH_RxThread, &a);
+	pthread_create(&threads[1], NULL, BENCH_TxThread, &a);
+	pthread_create(&threads[2], NULL, BENCH_RxThread, &b);
+	pthread_create(&threads[3], NULL, BENCH_TxThread, &b);
+	
+	while((AtomicLoad(&bench_duplex_received[0]) < BENCH_DUPLEX_BYTES)
+	or (AtomicLoad(&bench_duplex_received[1]) < BENCH_DUPLEX_BYTES)) { sched_yield(); }
+	
+	double elapsed = BENCH_Now() - start;
+	AtomicStore(&bench_duplex_done, true);
+	for(uint8_t i = 0; i < 4; i++){ pthread_join(threads[i], NULL); }
+	
+	printf("duplex split handlers %6.2f MB/s each way, %6.1f ns/byte, errors %u\n",
+		   BENCH_DUPLEX_BYTES / elapsed * 1e3, elapsed / BENCH_DUPLEX_BYTES, bench_duplex_errors);
+}
+
+void bench_fec(ssp_str* ssp, uint8_t fec_size)
+{
+	uint8_t codeword[BENCH_PAYLOAD_SIZE + FEC_SIZE_MAX];
+	uint8_t damaged[sizeof(codeword)];
+	const uint8_t size = BENCH_PAYLOAD_SIZE + fec_size;
+	
+	ssp->fec_size = fec_size;
+	
+	for(uint8_t i = 0; i < BENCH_PAYLOAD_SIZE; i++){ codeword[i] = BENCH_Random(); }
+	
+	// Encoding
+	double start = BENCH_Now();
+	for(uint32_t n = 0; n < BENCH_ITERATIONS; n++){
+		uint8_t parity[FEC_SIZE_MAX] = { 0 };
+		for(uint8_t i = 0; i < BENCH_PAYLOAD_SIZE; i++){ FecPush_(ssp, parity, codeword[i]); }
+		bench_sink ^= parity[0];
+		if(n == 0) { memcpy(&codeword[BENCH_PAYLOAD_SIZE], parity, fec_size); }
+	}
+	double encode = (BENCH_Now() - start) / BENCH_ITERATIONS / BENCH_PAYLOAD_SIZE;
+	
+	// Decoding without errors - syndromes only
+	start = BENCH_Now();
+	for(uint32_t n = 0; n < BENCH_ITERATIONS; n++){
+		bench_sink ^= FecCorrect_(ssp, codeword, size);
+	}
+	double clean = (BENCH_Now() - start) / BENCH_ITERATIONS / BENCH_PAYLOAD_SIZE;
+	
+	// Decoding with maximum correctable errors
+	start = BENCH_Now();
+	for(uint32_t n = 0; n < BENCH_ITERATIONS; n++){
+		memcpy(damaged, codeword, size);
+		for(uint8_t e = 0; e < fec_size / 2; e++){ damaged[(n + e * 13) % size] ^= 0x5A; }
+		bench_sink ^= FecCorrect_(ssp, damaged, size);
+	}
+	double corrected = (BENCH_Now() - start) / BENCH_ITERATIONS / BENCH_PAYLOAD_SIZE;
+	
+	printf("fec rs(%u,%u) encode %6.2f ns/byte, decode clean %6.2f ns/byte, "
+		   "decode %u errors %6.2f ns/byte\n",
+		   size, BENCH_PAYLOAD_SIZE, encode, clean, fec_size / 2, corrected);
+}
+
+void bench_compression(const char* name, const uint8_t* data, uint8_t size)
+{
+	uint8_t packed[PAYLOAD_SIZE_MAX];
+	uint8_t unpacked[PAYLOAD_SIZE_MAX];
+	uint8_t packed_size = 0;
+	
+	double start = BENCH_Now();
+	for(uint32_t n = 0; n < BENCH_ITERATIONS; n++){
+		packed_size = Compress_(data, size, packed, size - 1);
+		bench_sink ^= packed[0];
+	}
+	double compress = (BENCH_Now() - start) / BENCH_ITERATIONS / size;
+	
+	// Not shrinking frames are sent raw
+	double decompress = 0;
+	if(packed_size){
+		start = BENCH_Now();
+		for(uint32_t n = 0; n < BENCH_ITERATIONS; n++){
+			bench_sink ^= Decompress_(packed, packed_size, unpacked, sizeof(unpacked));
+		}
+		decompress = (BENCH_Now() - start) / BENCH_ITERATIONS / size;
+	}
+	
+	printf("lz %-10s %2u -> %2u bytes, ratio %4.2f, compress %6.2f ns/byte, "
+		   "decompress %6.2f ns/byte\n",
+		   name, size, packed_size? packed_size : size,
+		   (double)size / (packed_size? packed_size : size), compress, decompress);
+}
+
+int main(void)
+{
+	ssp_hub_str hub = { 0 };
+	hub.CRC8_Function = BENCH_DallasCRC8_;
+	
+	ssp_str ssp_object = { 0 };
+	ssp_object.hub = &hub;
+	
+	for(uint8_t fec_size = 2; fec_size <= FEC_SIZE_MAX; fec_size += 2){
+		bench_fec(&ssp_object, fec_size);
+	}
+	
+	uint8_t data[BENCH_PAYLOAD_SIZE];
+	
+	// Telemetry - 8 byte records, slowly changing values
+	for(uint8_t i = 0; i < sizeof(data); i += 8){
+		const uint8_t record[8] = { 0x01, 0x00, 0x10 + i / 8, 0x00, 0xE8, 0x03, 0x00, 0x00 };
+		memcpy(&data[i], record, 8);
+	}
+	bench_compression("telemetry", data, sizeof(data));
+	
+	const char text[] = "temp=21.5;hum=40.1;temp=21.6;hum=40.1;temp=21.6;";
+	bench_compression("text", (const uint8_t*)text, sizeof(data));
+	
+	for(uint8_t i = 0; i < sizeof(data); i++){ data[i] = BENCH_Random(); }
+	bench_compression("random", data, sizeof(data));
+	
+	// Scaling with producers only shows with cores to run them on
+	const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	if(cores < 2) { printf("queue on one core, producers take turns, no contention measured\n"); }
+	for(uint8_t producers = 1; producers <= BENCH_QUEUE_PRODUCERS; producers *= 2){
+		bench_queue(producers, false, cores);
+	}
+	for(uint8_t producers = 1; producers <= BENCH_QUEUE_PRODUCERS; producers *= 2){
+		bench_queue(producers, true, cores);
+	}
+	
+	bench_duplex();
+	
+	return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+#
+#	Small serial protocol micro benchmark comparison
+#
+#	compare.py baseline.json current.json [--threshold 0.25] [--floor 5]
+#		[--spread-factor 1] [--spread-max 0.25] [--normalize]
+#
+#	Results matched by stage, config, pattern and size. Slower than
+#	baseline by threshold (fraction), by spread times spread factor and
+#	by floor (ns) is a regression, exit status 1 if any. Spread is the
+#	interquartile range of repeats over their median, the bigger of
+#	both runs counts. Cases spread over spread max are too noisy to
+#	judge, they are listed and exit status is 2 if nothing regressed,
+#	rerun on a quieter machine. Back to back runs differ by up to 20% on
+#	a busy machine, threshold stays above that. Baseline is only
+#	meaningful on the machine it was made on, regenerate it with:
+#	micro > bench/baseline.json
+#	Normalize divides out median change of the whole run, so other
+#	machine or throttled CPU flags only stages slower than the rest.
+#
+
+import argparse
+import json
+import statistics
+import sys
+
+
+def load(path):
+	with open(path) as f:
+		results = json.load(f)["results"]
+	return {(r["stage"], r["config"], r["pattern"], r["size"]): r for r in results}
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Flag micro benchmark regressions")
+	parser.add_argument("baseline")
+	parser.add_argument("current")
+	parser.add_argument("--threshold", type=float, default=0.25,
+						help="allowed slowdown fraction (default 0.25)")
+	parser.add_argument("--floor", type=float, default=5.0,
+						help="slowdowns under this many ns per frame ignored (default 5)")
+	parser.add_argument("--spread-factor", type=float, default=1.0,
+						help="spread multiple a change must exceed (default 1)")
+	parser.add_argument("--spread-max", type=float, default=0.25,
+						help="cases noisier than this are not judged (default 0.25)")
+	parser.add_argument("--metric", default="ns_per_frame",
+						choices=["ns_per_frame", "ns_per_byte", "cycles_per_frame"])
+	parser.add_argument("--normalize", action="store_true",
+						help="scale current run by its median change first")
+	args = parser.parse_args()
+
+	baseline = load(args.baseline)
+	current = load(args.current)
+
+	pairs = []
+	noisy = []
+	for key, base in sorted(baseline.items()):
+		if key not in current:
+			print("missing  %-15s %-12s %-7s %3u" % key)
+			continue
+
+		old = base.get(args.metric)
+		new = current[key].get(args.metric)
+		spread = max(base.get("spread", 0), current[key].get("spread", 0))
+		if spread > args.spread_max:
+			noisy.append((key, spread))
+		elif old and new is not None:
+			pairs.append((key, old, new, spread))
+
+	scale = 1.0
+	if args.normalize and pairs:
+		scale = statistics.median(new / old for key, old, new, spread in pairs)
+		print("run scaled by %.3f" % (1 / scale))
+
+	regressions = []
+	improvements = []
+	for key, old, new, spread in pairs:
+		new /= scale
+		change = (new - old) / old
+		limit = max(args.threshold, args.spread_factor * spread)
+		if (change > limit) and (new - old > args.floor):
+			regressions.append((key, old, new, change, spread))
+		elif (change < -limit) and (old - new > args.floor):
+			improvements.append((key, old, new, change, spread))
+
+	for title, items in (("slower", regressions), ("faster", improvements)):
+		for key, old, new, change, spread in items:
+			print("%s   %-15s %-12s %-7s %3u  %10.2f -> %10.2f  %+6.1f%%  spread %.1f%%"
+				  % ((title,) + key + (old, new, change * 100, spread * 100)))
+
+	for key, spread in noisy:
+		print("noisy    %-15s %-12s %-7s %3u  spread %.1f%%" % (key + (spread * 100,)))
+
+	print("%u compared, %u slower, %u faster, %u noisy (%s, threshold %.0f%%)"
+		  % (len(pairs), len(regressions), len(improvements), len(noisy),
+			 args.metric, args.threshold * 100))
+	if regressions:
+		return 1
+	return 2 if noisy else 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
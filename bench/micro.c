@@ -0,0 +1,352 @@
+/*
+ *	Small serial protocol micro benchmarks
+ *
+ *	Cost of each stage per frame and per byte, as JSON on stdout.
+ *	Compare runs with bench/compare.py, bench/baseline.json is the
+ *	reference. Cycles are TSC ticks, x86 only.
+ *
+ *	Each figure is the median of MICRO_REPEATS batches of about
+ *	MICRO_BATCH_NS each, spread is their interquartile range over median.
+ *	Repeats go round all cases in turn, so a slow spell of the machine
+ *	hits every case once instead of all repeats of a few. Process is
+ *	pinned to the CPU it starts on, so migrations do not add to spread.
+ *
+ *	micro [batch iterations, calibrated per case if not given]
+ */
+
+#define _GNU_SOURCE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "ssp.h"
+#include "ssp.c"
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <x86intrin.h>
+#define MICRO_Cycles()			((double)__rdtsc())
+#define MICRO_HAS_CYCLES		(1)
+#else
+#define MICRO_Cycles()			(0.0)
+#define MICRO_HAS_CYCLES		(0)
+#endif
+
+#define MICRO_BATCH_NS			(2e6)
+#define MICRO_CALIBRATION		(100)
+#define MICRO_REPEATS			(31)
+
+#define MICRO_CONFIGS			(sizeof(micro_configs) / sizeof(micro_configs[0]))
+#define MICRO_SIZES				(sizeof(micro_sizes))
+
+static volatile uint8_t micro_sink;
+static uint32_t micro_iterations;
+
+static const uint8_t micro_sizes[] = { 1, 8, 16, 30 };
+
+typedef enum {
+	PATTERN_NONE,			// No collisions
+	PATTERN_FF,				// All END symbols
+	PATTERN_AA,				// All collision markers
+	PATTERN_RANDOM,
+	PATTERN_COUNT,
+}micro_pattern_enum;
+
+static const char* const micro_pattern_names[PATTERN_COUNT] = { "none", "ff", "aa", "random" };
+
+typedef struct {
+	const char* name;
+	ssp_framing_enum framing;
+	ssp_check_enum check_type;
+}micro_config_str;
+
+static const micro_config_str micro_configs[] = {
+	{ "escape_crc8",	SSP_FRAMING_ESCAPE,	SSP_CHECK_CRC8 },
+	{ "cobs_crc16",		SSP_FRAMING_COBS,	SSP_CHECK_CRC16 },
+	{ "cobs_crc32c",	SSP_FRAMING_COBS,	SSP_CHECK_CRC32C },
+};
+
+// Input gives payload again on every frame
+static uint8_t micro_payload[PAYLOAD_SIZE_MAX];
+static uint8_t micro_payload_size;
+static uint8_t micro_payload_index;
+
+// UART gives encoded frame again on every reception
+static uint8_t micro_frame[BUFFER_TOTAL_SIZE];
+static uint8_t micro_frame_size;
+static uint8_t micro_frame_index;
+
+static uint8_t MICRO_DallasCRC8_(uint8_t inbyte, uint8_t crc)
+{
+	for ( uint8_t j = 0; j < 8; ++j ){
+		uint8_t mix = (crc ^ inbyte) & 0x01;
+		crc >>= 1;
+		if ( mix ) crc ^= 0x8C;
+		inbyte >>= 1;
+	}
+	return crc;
+}
+
+static bool MICRO_UART_GetByte(uint8_t* value)
+{
+	if(micro_frame_index == micro_frame_size) { return false; }
+	*value = micro_frame[micro_frame_index++];
+	return true;
+}
+
+static bool MICRO_UART_PutByte(uint8_t value)
+{
+	micro_sink ^= value;
+	return true;
+}
+
+static bool MICRO_INPUT_GetByte(uint8_t* value)
+{
+	if(micro_payload_index == micro_payload_size) { return false; }
+	*value = micro_payload[micro_payload_index++];
+	return true;
+}
+
+static bool MICRO_OUTPUT_PutByte(uint8_t value)
+{
+	micro_sink ^= value;
+	return true;
+}
+
+static double MICRO_Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static uint32_t micro_random = 0x12345678;
+
+static uint8_t MICRO_Random(void)
+{
+	micro_random ^= micro_random << 13;
+	micro_random ^= micro_random >> 17;
+	micro_random ^= micro_random << 5;
+	return (uint8_t)micro_random;
+}
+
+static void MICRO_FillPayload(micro_pattern_enum pattern, uint8_t size)
+{
+	for(uint8_t i = 0; i < size; i++){
+		switch(pattern){
+			case PATTERN_NONE: micro_payload[i] = i % COLLISION_MARKER; break;
+			case PATTERN_FF: micro_payload[i] = END_MARKER; break;
+			case PATTERN_AA: micro_payload[i] = COLLISION_MARKER; break;
+			default: micro_payload[i] = MICRO_Random(); break;
+		}
+	}
+	micro_payload_size = size;
+}
+
+typedef enum {
+	STAGE_CREATE_FRAME,
+	STAGE_RECEPTION,
+	STAGE_CHECK,
+	STAGE_PUSH_TO_OUTPUT,
+	STAGE_PUSH_RECEIVED,
+	STAGE_COUNT,
+}micro_stage_enum;
+
+static const char* const micro_stage_names[STAGE_COUNT] = {
+	"create_frame", "reception", "check", "push_to_output", "push_received"
+};
+
+// One pass of a stage, state rewound before it
+static void MICRO_RunStage(ssp_str* ssp, micro_stage_enum stage)
+{
+	switch(stage){
+		case STAGE_CREATE_FRAME:
+			micro_payload_index = 0;
+			micro_sink ^= CreateFrame_(ssp);
+			break;
+
+		case STAGE_RECEPTION:
+			micro_frame_index = 0;
+			while(ReceptionHandler_(ssp) == NOTHING_RECEIVED) { }
+			micro_sink ^= ssp->rx.size;
+			ResetReceiver_(ssp);
+			break;
+
+		case STAGE_CHECK:
+			micro_sink ^= (uint8_t)CalculateCheck_(ssp, micro_payload, micro_payload_size);
+			break;
+
+		case STAGE_PUSH_TO_OUTPUT:
+			SetupTransmitterForFrame_(ssp);
+			micro_sink ^= PushAllToOutput_(ssp);
+			break;
+
+		// Payload of last reception is still in buffer
+		default:
+		case STAGE_PUSH_RECEIVED:
+			ssp->rx.index = 0;
+			ssp->rx.size = micro_payload_size;
+			micro_sink ^= PushAllReceivedData(ssp);
+			break;
+	}
+}
+
+#define MICRO_CASES				(MICRO_CONFIGS * PATTERN_COUNT * MICRO_SIZES)
+
+typedef struct {
+	uint32_t iterations;
+	double ns[MICRO_REPEATS];
+	double cycles[MICRO_REPEATS];
+}micro_result_str;
+
+static micro_result_str micro_results[MICRO_CASES][STAGE_COUNT];
+
+static void MICRO_Measure(ssp_str* ssp, micro_stage_enum stage, micro_result_str* result, uint8_t repeat)
+{
+	// Batch long enough for timer and scheduler ticks to even out
+	if(result->iterations == 0){
+		double start = MICRO_Now();
+		for(uint32_t n = 0; n < MICRO_CALIBRATION; n++){ MICRO_RunStage(ssp, stage); }
+		double elapsed = (MICRO_Now() - start) / MICRO_CALIBRATION;
+		result->iterations = micro_iterations? micro_iterations : (uint32_t)(MICRO_BATCH_NS / elapsed) + 1;
+	}
+	
+	double start = MICRO_Now();
+	double start_cycles = MICRO_Cycles();
+	for(uint32_t n = 0; n < result->iterations; n++){ MICRO_RunStage(ssp, stage); }
+	result->cycles[repeat] = (MICRO_Cycles() - start_cycles) / result->iterations;
+	result->ns[repeat] = (MICRO_Now() - start) / result->iterations;
+}
+
+static bool MICRO_Run(const micro_config_str* config, micro_pattern_enum pattern, uint8_t size,
+					  micro_result_str* results, uint8_t repeat)
+{
+	static ssp_str ssp_object;
+	ssp_str* ssp = &ssp_object;
+
+	ssp_init_str init = { 0 };
+	init.CRC8_Function = MICRO_DallasCRC8_;
+	init.UART_GetByte_ = MICRO_UART_GetByte;
+	init.UART_PutByte_ = MICRO_UART_PutByte;
+	init.INPUT_GetByte_ = MICRO_INPUT_GetByte;
+	init.OUTPUT_PutByte_ = MICRO_OUTPUT_PutByte;
+	init.framing = config->framing;
+	init.check_type = config->check_type;
+	if(not SPP_Init(ssp, &init)) { return false; }
+	
+	micro_random = 0x12345678;
+	MICRO_FillPayload(pattern, size);
+	
+	// Whole payload must fit one frame, or figures are per less bytes
+	micro_payload_index = 0;
+	if(not CreateFrame_(ssp) or (micro_payload_index != size)) { return false; }
+	
+	// Frame on the wire is what receiver parses
+	memcpy(micro_frame, Block_(ssp, ssp->tx.frame.data), ssp->tx.frame.size);
+	micro_frame_size = ssp->tx.frame.size;
+	micro_frame_index = 0;
+	while(ReceptionHandler_(ssp) == NOTHING_RECEIVED) {
+		if(micro_frame_index == micro_frame_size) { return false; }
+	}
+	if(ssp->rx.size != size) { return false; }
+	
+	for(micro_stage_enum stage = 0; stage < STAGE_COUNT; stage++){
+		MICRO_Measure(ssp, stage, &results[stage], repeat);
+	}
+	
+	ResetReceiver_(ssp);
+	return true;
+}
+
+static int MICRO_Compare(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// Sorts samples, quartiles by nearest rank
+static double MICRO_Median(double* samples, double* spread)
+{
+	qsort(samples, MICRO_REPEATS, sizeof(samples[0]), MICRO_Compare);
+	double median = samples[MICRO_REPEATS / 2];
+	double range = samples[(3 * MICRO_REPEATS) / 4] - samples[MICRO_REPEATS / 4];
+	if(spread) { *spread = (median > 0)? range / median : 0; }
+	return median;
+}
+
+static void MICRO_Pin(void)
+{
+#if defined(__linux__)
+	int cpu = sched_getcpu();
+	if(cpu < 0) { return; }
+	
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if(sched_setaffinity(0, sizeof(set), &set) != 0) { fprintf(stderr, "not pinned to CPU %d\n", cpu); }
+#endif
+}
+
+int main(int argc, char** argv)
+{
+	if(argc > 1) { micro_iterations = (uint32_t)strtoul(argv[1], NULL, 10); }
+	MICRO_Pin();
+	
+	for(uint8_t repeat = 0; repeat < MICRO_REPEATS; repeat++){
+		uint16_t index = 0;
+		for(uint8_t c = 0; c < MICRO_CONFIGS; c++){
+			for(micro_pattern_enum pattern = 0; pattern < PATTERN_COUNT; pattern++){
+				for(uint8_t s = 0; s < MICRO_SIZES; s++, index++){
+					if(not MICRO_Run(&micro_configs[c], pattern, micro_sizes[s], micro_results[index], repeat)){
+						fprintf(stderr, "%s %s %u failed\n", micro_configs[c].name,
+								micro_pattern_names[pattern], micro_sizes[s]);
+						return 1;
+					}
+				}
+			}
+		}
+	}
+	
+	printf("{\n  \"timer\": \"clock_gettime%s\",\n  \"batch_ns\": %.0f,\n  \"repeats\": %u,\n  \"results\": [",
+		   MICRO_HAS_CYCLES? " rdtsc" : "", micro_iterations? 0 : MICRO_BATCH_NS, MICRO_REPEATS);
+	
+	uint16_t index = 0;
+	for(uint8_t c = 0; c < MICRO_CONFIGS; c++){
+		for(micro_pattern_enum pattern = 0; pattern < PATTERN_COUNT; pattern++){
+			for(uint8_t s = 0; s < MICRO_SIZES; s++, index++){
+				for(micro_stage_enum stage = 0; stage < STAGE_COUNT; stage++){
+					micro_result_str* result = &micro_results[index][stage];
+					double spread;
+					double ns = MICRO_Median(result->ns, &spread);
+					double cycles = MICRO_Median(result->cycles, NULL);
+					
+					printf("%s\n    {\"stage\": \"%s\", \"config\": \"%s\", \"pattern\": \"%s\", \"size\": %u, "
+						   "\"ns_per_frame\": %.2f, \"ns_per_byte\": %.3f, \"spread\": %.3f, \"iterations\": %u, ",
+						   (index or stage)? "," : "", micro_stage_names[stage], micro_configs[c].name,
+						   micro_pattern_names[pattern], micro_sizes[s], ns, ns / micro_sizes[s], spread, 
+						   result->iterations);
+					if(MICRO_HAS_CYCLES) { printf("\"cycles_per_frame\": %.1f}", cycles); }
+					else { printf("\"cycles_per_frame\": null}"); }
+				}
+			}
+		}
+	}
+	
+	printf("\n  ]\n}\n");
+	return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,17 +17,64 @@ extern "C" {
 #include <string.h>
 #include <iso646.h>
 
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#elif defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__))
+// Built for any x86, SSE4.2 taken at run time if CPU has it
+#include <nmmintrin.h>
+#define CRC32C_DISPATCH			(1)
+#endif
+
+#ifndef CRC32C_DISPATCH
+#define CRC32C_DISPATCH			(0)
+#endif
+
 #include "ssp.h"
 
 // STD Macro
 //
 #define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+// Check Macro
+//
+#define ResetCheck(ssp_obj)		(ssp_obj->check = CheckSeed_(ssp_obj))
+#define PushCheck(ssp_obj, x)	(ssp_obj->check = CheckUpdate_(ssp_obj, x, ssp_obj->check))
+#define GetCheck(ssp_obj)		(CheckFinal_(ssp_obj, ssp_obj->check))
+
+// Escaping with CRC8 keeps original wire format:
+// CRC8 over escaped bytes, CRC8 0xFF replaced by COLLISION_MARKER.
+#define IsLegacyFrame(ssp_obj)	((ssp_obj->framing == SSP_FRAMING_ESCAPE) \
+								and (ssp_obj->check_type == SSP_CHECK_CRC8) \
+								and (ssp_obj->fec_size == 0) \
+								and (ssp_obj->control_size == 0))
+
+// Atomic Macro
+// Without GCC builtins pool, queue and split handlers are safe for single thread only
+#if defined(__GNUC__)
+#define AtomicLoad(ptr)					__atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define AtomicStore(ptr, value)			__atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#define AtomicCompareSwap(ptr, expected, desired) \
+		__atomic_compare_exchange_n(ptr, expected, desired, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define AtomicAdd(ptr, value)			__atomic_fetch_add(ptr, value, __ATOMIC_RELAXED)
+#define AtomicLoadRelaxed(ptr)			__atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define AtomicStoreRelaxed(ptr, value)	__atomic_store_n(ptr, value, __ATOMIC_RELAXED)
+#else
+#define AtomicLoad(ptr)					(*(ptr))
+#define AtomicStore(ptr, value)			(*(ptr) = (value))
+#define AtomicCompareSwap(ptr, expected, desired) \
+		((*(ptr) == *(expected))? (*(ptr) = (desired), true) : (*(expected) = *(ptr), false))
+#define AtomicAdd(ptr, value)			(*(ptr) += (value))
+#define AtomicLoadRelaxed(ptr)			(*(ptr))
+#define AtomicStoreRelaxed(ptr, value)	(*(ptr) = (value))
+#endif
 
-// CRC8 Macro
+// GF(256) Macro
 //
-#define ResetCRC8(ssp_obj)		(ssp_obj->crc8 = 0)
-#define PushCRC8(ssp_obj, x)	(ssp_obj->crc8 = ssp_obj->CRC8_Function(x, ssp_obj->crc8))
-#define GetCRC8(ssp_obj)		(ssp_obj->crc8)
+#define GF_Mul(a, b)			(((a) and (b))? gf_exp[gf_log[a] + gf_log[b]] : 0)
+#define GF_Div(a, b)			((a)? gf_exp[gf_log[a] + 255 - gf_log[b]] : 0)
 
 // Local types
 //
@@ -37,12 +84,35 @@ typedef enum {
 	ACK_RECEIVED,
 	FRAME_RECEIVED,
 	BROKEN_RECEIVED,
+	HELLO_RECEIVED,
 }ssp_rx_answer_enum;
 
+typedef struct {
+	uint8_t* data;
+	uint8_t size;
+	uint8_t code_index;
+	uint8_t parity[FEC_SIZE_MAX];
+}ssp_encoder_str;
+
 // Local functions declaration
 //
-static inline void CreateAck_(ssp_str* ssp, uint8_t id_to_ack);
+static inline bool CreateAck_(ssp_str* ssp, uint8_t id_to_ack);
 static inline bool CreateFrame_(ssp_str* ssp);
+static inline bool CreateFrameAbove_(ssp_str* ssp, uint16_t priority_end);
+static inline uint8_t CollectInput_(ssp_str* ssp, uint8_t channel, uint8_t* data, uint8_t size_max);
+static inline uint8_t ScheduleChannel_(ssp_str* ssp, uint8_t* first, uint16_t priority_end, uint8_t size_max);
+static inline bool InitChannels_(ssp_hub_str* hub, const ssp_init_str* config);
+static inline bool IsAggregationReady_(ssp_str* ssp);
+static inline bool PushAllReceivedRecords_(ssp_str* ssp);
+static inline bool PushAllBuffered_(ssp_str* ssp);
+static inline bool BufferReceived_(ssp_str* ssp);
+static inline uint8_t GetCredit_(ssp_str* ssp);
+static inline uint8_t GetSendSizeMax_(ssp_str* ssp);
+static inline void EncodeFrame_(ssp_str* ssp, const uint8_t* data, uint8_t size, uint8_t control, uint8_t id);
+static inline uint8_t GetEncodedSize_(ssp_str* ssp, const uint8_t* data, uint8_t size);
+static inline uint8_t GetEscapedSize_(const uint8_t* data, uint8_t size);
+static inline uint8_t Compress_(const uint8_t* data, uint8_t size, uint8_t* output, uint8_t size_max);
+static inline uint8_t Decompress_(const uint8_t* data, uint8_t size, uint8_t* output, uint8_t size_max);
 static inline void SetupTransmitterForAck_(ssp_str* ssp);
 static inline void SetupTransmitterForFrame_(ssp_str* ssp);
 static inline ssp_rx_answer_enum ReceptionHandler_(ssp_str* ssp);
@@ -50,7 +120,217 @@ static inline bool TransmissionHandler_(ssp_str* ssp);
 static inline uint8_t GenerateNewID_(uint8_t previous_id);
 static inline bool PushAllReceivedData(ssp_str* ssp);
 static inline bool PushAllToOutput_(ssp_str* ssp);
+static inline void PacingRefill_(ssp_str* ssp, ssp_cold_str* cold);
+static inline bool HandshakeTransmit_(ssp_str* ssp);
+static inline void HandshakeReceived_(ssp_str* ssp);
+static inline void HandshakeApply_(ssp_str* ssp, bool with_peer);
+static inline bool CreateHello_(ssp_str* ssp);
+static inline bool IsHello_(ssp_str* ssp, uint8_t size);
+static inline uint8_t HelloCheck_(ssp_str* ssp, const uint8_t* data, uint8_t size);
+static inline void SessionHeard_(ssp_str* ssp);
+static inline bool PrepareFrame_(ssp_str* ssp);
+static inline void PrepareNext_(ssp_str* ssp);
+static inline bool CreateUrgent_(ssp_str* ssp);
+static inline void SwapFrames_(ssp_str* ssp);
+static inline void ReleaseFrame_(ssp_str* ssp);
+static inline uint8_t* Block_(const ssp_str* ssp, uint16_t block);
+static inline ssp_cold_str* Cold_(const ssp_str* ssp);
+static inline uint8_t* Fifo_(const ssp_str* ssp);
+static inline bool TakeBlock_(ssp_str* ssp, uint16_t* block);
+static inline void GiveBlock_(ssp_str* ssp, uint16_t* block);
+static inline uint16_t PoolTake_(ssp_pool_str* pool);
+static inline void PoolGive_(ssp_pool_str* pool, uint16_t index);
+static inline uint16_t GetBlockNext_(const ssp_pool_str* pool, uint16_t index);
+static inline void SetBlockNext_(ssp_pool_str* pool, uint16_t index, uint16_t next);
+static inline void DrainQueue_(ssp_str* ssp);
+static inline void RequestAck_(ssp_str* ssp, uint8_t id);
+static inline bool IsAckRequested_(ssp_str* ssp);
+static inline void ReadLink_(ssp_str* ssp);
+static inline bool GetByte_(ssp_str* ssp, uint8_t* value);
+static inline bool PutBlock_(ssp_str* ssp);
+static inline void BusTransmit_(ssp_str* ssp);
 static inline void ResetReceiver_(ssp_str* ssp);
+static inline void EncoderInit_(ssp_str* ssp, ssp_encoder_str* enc, uint8_t* data, bool is_final);
+static inline void EncodeByte_(ssp_str* ssp, ssp_encoder_str* enc, uint8_t value);
+static inline void PutEncoded_(ssp_str* ssp, ssp_encoder_str* enc, uint8_t value);
+static inline void EncodeCheck_(ssp_str* ssp, ssp_encoder_str* enc);
+static inline bool DecodeEscaped_(uint8_t* data, uint8_t* size);
+static inline bool LocateEscaped_(ssp_str* ssp, uint8_t* size);
+static inline bool IsEscapedValid_(ssp_str* ssp, const uint8_t* frame, uint8_t size);
+static inline bool IsCheckValid_(ssp_str* ssp, const uint8_t* data, uint8_t index);
+static inline bool DecodeCOBS_(uint8_t* data, uint8_t* size);
+static inline uint8_t GetInputSizeMax_(ssp_str* ssp);
+static inline bool IsQueueFitting_(const ssp_str* ssp, const uint8_t* data, uint8_t size);
+static inline uint32_t CheckSeed_(const ssp_str* ssp);
+static inline uint32_t CheckUpdate_(const ssp_str* ssp, uint8_t value, uint32_t check);
+static inline uint32_t CheckFinal_(const ssp_str* ssp, uint32_t check);
+static inline uint32_t CalculateCheck_(ssp_str* ssp, const uint8_t* data, uint8_t size);
+static inline void UpdateCheck_(ssp_str* ssp, const uint8_t* data, uint8_t size);
+static inline uint32_t CheckBlock_(const ssp_str* ssp, const uint8_t* data, uint8_t size, uint32_t check);
+#if CRC32C_DISPATCH
+__attribute__((target("sse4.2"))) static uint32_t CheckBlockSse42_(const uint8_t* data, uint8_t size, uint32_t check);
+#endif
+static inline void FecPush_(const ssp_str* ssp, uint8_t* parity, uint8_t value);
+static inline bool FecCorrect_(const ssp_str* ssp, uint8_t* data, uint8_t size);
+
+// Local constants
+//
+static const uint8_t check_size_table[] = { 
+	[SSP_CHECK_CRC8] = 1, 
+	[SSP_CHECK_CRC16] = 2, 
+	[SSP_CHECK_CRC32C] = 4,
+};
+
+static const uint16_t crc16_table[256] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+	0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+	0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+	0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+	0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+	0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+	0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+	0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+	0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+	0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+	0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+	0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+	0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+	0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+	0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+	0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+	0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+	0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+	0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+	0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+	0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+	0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+	0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+	0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+	0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+	0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+	0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+	0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+	0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+// Doubled to skip modulo in GF_Mul
+static const uint8_t gf_exp[512] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1D, 0x3A, 0x74, 0xE8, 0xCD, 0x87, 0x13, 0x26,
+	0x4C, 0x98, 0x2D, 0x5A, 0xB4, 0x75, 0xEA, 0xC9, 0x8F, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0,
+	0x9D, 0x27, 0x4E, 0x9C, 0x25, 0x4A, 0x94, 0x35, 0x6A, 0xD4, 0xB5, 0x77, 0xEE, 0xC1, 0x9F, 0x23,
+	0x46, 0x8C, 0x05, 0x0A, 0x14, 0x28, 0x50, 0xA0, 0x5D, 0xBA, 0x69, 0xD2, 0xB9, 0x6F, 0xDE, 0xA1,
+	0x5F, 0xBE, 0x61, 0xC2, 0x99, 0x2F, 0x5E, 0xBC, 0x65, 0xCA, 0x89, 0x0F, 0x1E, 0x3C, 0x78, 0xF0,
+	0xFD, 0xE7, 0xD3, 0xBB, 0x6B, 0xD6, 0xB1, 0x7F, 0xFE, 0xE1, 0xDF, 0xA3, 0x5B, 0xB6, 0x71, 0xE2,
+	0xD9, 0xAF, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0D, 0x1A, 0x34, 0x68, 0xD0, 0xBD, 0x67, 0xCE,
+	0x81, 0x1F, 0x3E, 0x7C, 0xF8, 0xED, 0xC7, 0x93, 0x3B, 0x76, 0xEC, 0xC5, 0x97, 0x33, 0x66, 0xCC,
+	0x85, 0x17, 0x2E, 0x5C, 0xB8, 0x6D, 0xDA, 0xA9, 0x4F, 0x9E, 0x21, 0x42, 0x84, 0x15, 0x2A, 0x54,
+	0xA8, 0x4D, 0x9A, 0x29, 0x52, 0xA4, 0x55, 0xAA, 0x49, 0x92, 0x39, 0x72, 0xE4, 0xD5, 0xB7, 0x73,
+	0xE6, 0xD1, 0xBF, 0x63, 0xC6, 0x91, 0x3F, 0x7E, 0xFC, 0xE5, 0xD7, 0xB3, 0x7B, 0xF6, 0xF1, 0xFF,
+	0xE3, 0xDB, 0xAB, 0x4B, 0x96, 0x31, 0x62, 0xC4, 0x95, 0x37, 0x6E, 0xDC, 0xA5, 0x57, 0xAE, 0x41,
+	0x82, 0x19, 0x32, 0x64, 0xC8, 0x8D, 0x07, 0x0E, 0x1C, 0x38, 0x70, 0xE0, 0xDD, 0xA7, 0x53, 0xA6,
+	0x51, 0xA2, 0x59, 0xB2, 0x79, 0xF2, 0xF9, 0xEF, 0xC3, 0x9B, 0x2B, 0x56, 0xAC, 0x45, 0x8A, 0x09,
+	0x12, 0x24, 0x48, 0x90, 0x3D, 0x7A, 0xF4, 0xF5, 0xF7, 0xF3, 0xFB, 0xEB, 0xCB, 0x8B, 0x0B, 0x16,
+	0x2C, 0x58, 0xB0, 0x7D, 0xFA, 0xE9, 0xCF, 0x83, 0x1B, 0x36, 0x6C, 0xD8, 0xAD, 0x47, 0x8E, 0x01,
+	0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1D, 0x3A, 0x74, 0xE8, 0xCD, 0x87, 0x13, 0x26, 0x4C,
+	0x98, 0x2D, 0x5A, 0xB4, 0x75, 0xEA, 0xC9, 0x8F, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0, 0x9D,
+	0x27, 0x4E, 0x9C, 0x25, 0x4A, 0x94, 0x35, 0x6A, 0xD4, 0xB5, 0x77, 0xEE, 0xC1, 0x9F, 0x23, 0x46,
+	0x8C, 0x05, 0x0A, 0x14, 0x28, 0x50, 0xA0, 0x5D, 0xBA, 0x69, 0xD2, 0xB9, 0x6F, 0xDE, 0xA1, 0x5F,
+	0xBE, 0x61, 0xC2, 0x99, 0x2F, 0x5E, 0xBC, 0x65, 0xCA, 0x89, 0x0F, 0x1E, 0x3C, 0x78, 0xF0, 0xFD,
+	0xE7, 0xD3, 0xBB, 0x6B, 0xD6, 0xB1, 0x7F, 0xFE, 0xE1, 0xDF, 0xA3, 0x5B, 0xB6, 0x71, 0xE2, 0xD9,
+	0xAF, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0D, 0x1A, 0x34, 0x68, 0xD0, 0xBD, 0x67, 0xCE, 0x81,
+	0x1F, 0x3E, 0x7C, 0xF8, 0xED, 0xC7, 0x93, 0x3B, 0x76, 0xEC, 0xC5, 0x97, 0x33, 0x66, 0xCC, 0x85,
+	0x17, 0x2E, 0x5C, 0xB8, 0x6D, 0xDA, 0xA9, 0x4F, 0x9E, 0x21, 0x42, 0x84, 0x15, 0x2A, 0x54, 0xA8,
+	0x4D, 0x9A, 0x29, 0x52, 0xA4, 0x55, 0xAA, 0x49, 0x92, 0x39, 0x72, 0xE4, 0xD5, 0xB7, 0x73, 0xE6,
+	0xD1, 0xBF, 0x63, 0xC6, 0x91, 0x3F, 0x7E, 0xFC, 0xE5, 0xD7, 0xB3, 0x7B, 0xF6, 0xF1, 0xFF, 0xE3,
+	0xDB, 0xAB, 0x4B, 0x96, 0x31, 0x62, 0xC4, 0x95, 0x37, 0x6E, 0xDC, 0xA5, 0x57, 0xAE, 0x41, 0x82,
+	0x19, 0x32, 0x64, 0xC8, 0x8D, 0x07, 0x0E, 0x1C, 0x38, 0x70, 0xE0, 0xDD, 0xA7, 0x53, 0xA6, 0x51,
+	0xA2, 0x59, 0xB2, 0x79, 0xF2, 0xF9, 0xEF, 0xC3, 0x9B, 0x2B, 0x56, 0xAC, 0x45, 0x8A, 0x09, 0x12,
+	0x24, 0x48, 0x90, 0x3D, 0x7A, 0xF4, 0xF5, 0xF7, 0xF3, 0xFB, 0xEB, 0xCB, 0x8B, 0x0B, 0x16, 0x2C,
+	0x58, 0xB0, 0x7D, 0xFA, 0xE9, 0xCF, 0x83, 0x1B, 0x36, 0x6C, 0xD8, 0xAD, 0x47, 0x8E, 0x01, 0x02,
+};
+
+static const uint8_t gf_log[256] = {
+	0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1A, 0xC6, 0x03, 0xDF, 0x33, 0xEE, 0x1B, 0x68, 0xC7, 0x4B,
+	0x04, 0x64, 0xE0, 0x0E, 0x34, 0x8D, 0xEF, 0x81, 0x1C, 0xC1, 0x69, 0xF8, 0xC8, 0x08, 0x4C, 0x71,
+	0x05, 0x8A, 0x65, 0x2F, 0xE1, 0x24, 0x0F, 0x21, 0x35, 0x93, 0x8E, 0xDA, 0xF0, 0x12, 0x82, 0x45,
+	0x1D, 0xB5, 0xC2, 0x7D, 0x6A, 0x27, 0xF9, 0xB9, 0xC9, 0x9A, 0x09, 0x78, 0x4D, 0xE4, 0x72, 0xA6,
+	0x06, 0xBF, 0x8B, 0x62, 0x66, 0xDD, 0x30, 0xFD, 0xE2, 0x98, 0x25, 0xB3, 0x10, 0x91, 0x22, 0x88,
+	0x36, 0xD0, 0x94, 0xCE, 0x8F, 0x96, 0xDB, 0xBD, 0xF1, 0xD2, 0x13, 0x5C, 0x83, 0x38, 0x46, 0x40,
+	0x1E, 0x42, 0xB6, 0xA3, 0xC3, 0x48, 0x7E, 0x6E, 0x6B, 0x3A, 0x28, 0x54, 0xFA, 0x85, 0xBA, 0x3D,
+	0xCA, 0x5E, 0x9B, 0x9F, 0x0A, 0x15, 0x79, 0x2B, 0x4E, 0xD4, 0xE5, 0xAC, 0x73, 0xF3, 0xA7, 0x57,
+	0x07, 0x70, 0xC0, 0xF7, 0x8C, 0x80, 0x63, 0x0D, 0x67, 0x4A, 0xDE, 0xED, 0x31, 0xC5, 0xFE, 0x18,
+	0xE3, 0xA5, 0x99, 0x77, 0x26, 0xB8, 0xB4, 0x7C, 0x11, 0x44, 0x92, 0xD9, 0x23, 0x20, 0x89, 0x2E,
+	0x37, 0x3F, 0xD1, 0x5B, 0x95, 0xBC, 0xCF, 0xCD, 0x90, 0x87, 0x97, 0xB2, 0xDC, 0xFC, 0xBE, 0x61,
+	0xF2, 0x56, 0xD3, 0xAB, 0x14, 0x2A, 0x5D, 0x9E, 0x84, 0x3C, 0x39, 0x53, 0x47, 0x6D, 0x41, 0xA2,
+	0x1F, 0x2D, 0x43, 0xD8, 0xB7, 0x7B, 0xA4, 0x76, 0xC4, 0x17, 0x49, 0xEC, 0x7F, 0x0C, 0x6F, 0xF6,
+	0x6C, 0xA1, 0x3B, 0x52, 0x29, 0x9D, 0x55, 0xAA, 0xFB, 0x60, 0x86, 0xB1, 0xBB, 0xCC, 0x3E, 0x5A,
+	0xCB, 0x59, 0x5F, 0xB0, 0x9C, 0xA9, 0xA0, 0x51, 0x0B, 0xF5, 0x16, 0xEB, 0x7A, 0x75, 0x2C, 0xD7,
+	0x4F, 0xAE, 0xD5, 0xE9, 0xE6, 0xE7, 0xAD, 0xE8, 0x74, 0xD6, 0xF4, 0xEA, 0xA8, 0x50, 0x58, 0xAF,
+};
+
+// Generator per FEC size - product of (x - a^j), j < size. Highest power first.
+static const uint8_t fec_generator_table[FEC_SIZE_MAX + 1][FEC_SIZE_MAX + 1] = {
+	{ 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+	{ 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+	{ 0x01, 0x03, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+	{ 0x01, 0x07, 0x0E, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00 },
+	{ 0x01, 0x0F, 0x36, 0x78, 0x40, 0x00, 0x00, 0x00, 0x00 },
+	{ 0x01, 0x1F, 0xC6, 0x3F, 0x93, 0x74, 0x00, 0x00, 0x00 },
+	{ 0x01, 0x3F, 0x01, 0xDA, 0x20, 0xE3, 0x26, 0x00, 0x00 },
+	{ 0x01, 0x7F, 0x7A, 0x9A, 0xA4, 0x0B, 0x44, 0x75, 0x00 },
+	{ 0x01, 0xFF, 0x0B, 0x51, 0x36, 0xEF, 0xAD, 0xC8, 0x18 },
+};
+
+#if not defined(__SSE4_2__) and not defined(__ARM_FEATURE_CRC32)
+static const uint32_t crc32c_table[256] = {
+	0x00000000, 0xF26B8303, 0xE13B70F7, 0x1350F3F4, 0xC79A971F, 0x35F1141C,
+	0x26A1E7E8, 0xD4CA64EB, 0x8AD958CF, 0x78B2DBCC, 0x6BE22838, 0x9989AB3B,
+	0x4D43CFD0, 0xBF284CD3, 0xAC78BF27, 0x5E133C24, 0x105EC76F, 0xE235446C,
+	0xF165B798, 0x030E349B, 0xD7C45070, 0x25AFD373, 0x36FF2087, 0xC494A384,
+	0x9A879FA0, 0x68EC1CA3, 0x7BBCEF57, 0x89D76C54, 0x5D1D08BF, 0xAF768BBC,
+	0xBC267848, 0x4E4DFB4B, 0x20BD8EDE, 0xD2D60DDD, 0xC186FE29, 0x33ED7D2A,
+	0xE72719C1, 0x154C9AC2, 0x061C6936, 0xF477EA35, 0xAA64D611, 0x580F5512,
+	0x4B5FA6E6, 0xB93425E5, 0x6DFE410E, 0x9F95C20D, 0x8CC531F9, 0x7EAEB2FA,
+	0x30E349B1, 0xC288CAB2, 0xD1D83946, 0x23B3BA45, 0xF779DEAE, 0x05125DAD,
+	0x1642AE59, 0xE4292D5A, 0xBA3A117E, 0x4851927D, 0x5B016189, 0xA96AE28A,
+	0x7DA08661, 0x8FCB0562, 0x9C9BF696, 0x6EF07595, 0x417B1DBC, 0xB3109EBF,
+	0xA0406D4B, 0x522BEE48, 0x86E18AA3, 0x748A09A0, 0x67DAFA54, 0x95B17957,
+	0xCBA24573, 0x39C9C670, 0x2A993584, 0xD8F2B687, 0x0C38D26C, 0xFE53516F,
+	0xED03A29B, 0x1F682198, 0x5125DAD3, 0xA34E59D0, 0xB01EAA24, 0x42752927,
+	0x96BF4DCC, 0x64D4CECF, 0x77843D3B, 0x85EFBE38, 0xDBFC821C, 0x2997011F,
+	0x3AC7F2EB, 0xC8AC71E8, 0x1C661503, 0xEE0D9600, 0xFD5D65F4, 0x0F36E6F7,
+	0x61C69362, 0x93AD1061, 0x80FDE395, 0x72966096, 0xA65C047D, 0x5437877E,
+	0x4767748A, 0xB50CF789, 0xEB1FCBAD, 0x197448AE, 0x0A24BB5A, 0xF84F3859,
+	0x2C855CB2, 0xDEEEDFB1, 0xCDBE2C45, 0x3FD5AF46, 0x7198540D, 0x83F3D70E,
+	0x90A324FA, 0x62C8A7F9, 0xB602C312, 0x44694011, 0x5739B3E5, 0xA55230E6,
+	0xFB410CC2, 0x092A8FC1, 0x1A7A7C35, 0xE811FF36, 0x3CDB9BDD, 0xCEB018DE,
+	0xDDE0EB2A, 0x2F8B6829, 0x82F63B78, 0x709DB87B, 0x63CD4B8F, 0x91A6C88C,
+	0x456CAC67, 0xB7072F64, 0xA457DC90, 0x563C5F93, 0x082F63B7, 0xFA44E0B4,
+	0xE9141340, 0x1B7F9043, 0xCFB5F4A8, 0x3DDE77AB, 0x2E8E845F, 0xDCE5075C,
+	0x92A8FC17, 0x60C37F14, 0x73938CE0, 0x81F80FE3, 0x55326B08, 0xA759E80B,
+	0xB4091BFF, 0x466298FC, 0x1871A4D8, 0xEA1A27DB, 0xF94AD42F, 0x0B21572C,
+	0xDFEB33C7, 0x2D80B0C4, 0x3ED04330, 0xCCBBC033, 0xA24BB5A6, 0x502036A5,
+	0x4370C551, 0xB11B4652, 0x65D122B9, 0x97BAA1BA, 0x84EA524E, 0x7681D14D,
+	0x2892ED69, 0xDAF96E6A, 0xC9A99D9E, 0x3BC21E9D, 0xEF087A76, 0x1D63F975,
+	0x0E330A81, 0xFC588982, 0xB21572C9, 0x407EF1CA, 0x532E023E, 0xA145813D,
+	0x758FE5D6, 0x87E466D5, 0x94B49521, 0x66DF1622, 0x38CC2A06, 0xCAA7A905,
+	0xD9F75AF1, 0x2B9CD9F2, 0xFF56BD19, 0x0D3D3E1A, 0x1E6DCDEE, 0xEC064EED,
+	0xC38D26C4, 0x31E6A5C7, 0x22B65633, 0xD0DDD530, 0x0417B1DB, 0xF67C32D8,
+	0xE52CC12C, 0x1747422F, 0x49547E0B, 0xBB3FFD08, 0xA86F0EFC, 0x5A048DFF,
+	0x8ECEE914, 0x7CA56A17, 0x6FF599E3, 0x9D9E1AE0, 0xD3D3E1AB, 0x21B862A8,
+	0x32E8915C, 0xC083125F, 0x144976B4, 0xE622F5B7, 0xF5720643, 0x07198540,
+	0x590AB964, 0xAB613A67, 0xB831C993, 0x4A5A4A90, 0x9E902E7B, 0x6CFBAD78,
+	0x7FAB5E8C, 0x8DC0DD8F, 0xE330A81A, 0x115B2B19, 0x020BD8ED, 0xF0605BEE,
+	0x24AA3F05, 0xD6C1BC06, 0xC5914FF2, 0x37FACCF1, 0x69E9F0D5, 0x9B8273D6,
+	0x88D28022, 0x7AB90321, 0xAE7367CA, 0x5C18E4C9, 0x4F48173D, 0xBD23943E,
+	0xF36E6F75, 0x0105EC76, 0x12551F82, 0xE03E9C81, 0x34F4F86A, 0xC69F7B69,
+	0xD5CF889D, 0x27A40B9E, 0x79B737BA, 0x8BDCB4B9, 0x988C474D, 0x6AE7C44E,
+	0xBE2DA0A5, 0x4C4623A6, 0x5F16D052, 0xAD7D5351,
+};
+#endif
 
 /*
  *  SSP short description.
@@ -72,57 +352,526 @@ static inline void ResetReceiver_(ssp_str* ssp);
  *  Parcel per byte representation example:
  *   - 4 payload bytes
  *   - 1 with collisions
- *	[D n] [D n+1] [CM n+2] [CR] [D n+3] [ID] [SIZE] [CRC8] [END]
+ *	[D n] [D n+1] [CM n+2] [CR] [D n+3] [SIZE] [ID] [CRC8] [END]
+ *	
+ *  Frame is found back from END by its SIZE, so frame after one with
+ *  damaged END is still received. Only the latest bytes are kept then.
+ *	
+ *  COBS framing (SSP_FRAMING_COBS):
+ *  Payload and header are encoded as one block, END symbol plays zero role.
+ *  Each code byte holds distance to next encoded 0xFF (or end of block).
+ *  Code bytes never exceed 0xFE, so one code byte per 253 bytes is added.
+ *  CRC8 is calculated over raw bytes and never needs collision handling.
+ *  
+ *  Max payload size - 59 bytes (Any content)
+ *  
+ *	[CODE] [D n] [D n+1] [CODE] [D n+3] [SIZE] [ID] [CRC8] [END]
+ *	
+ *  Integrity check (ssp_check_enum):
+ *  CRC8 - user function, CRC16-CCITT or CRC32C, sent little endian.
+ *  Escaping with CRC8 is the legacy format, described above.
+ *  Any other combination checks raw payload, SIZE and ID,
+ *  SIZE holds raw payload size and check bytes are encoded as data.
+ *  CRC32C blocks use SSE4.2 or ARMv8 CRC instructions when built for them,
+ *  x86 builds without SSE4.2 check CPU at run time, table otherwise.
+ *  
+ *	[D n] [CM n+1] [CR] [SIZE] [ID] [CRC16 L] [CM CRC16 H] [CR] [END]
+ *	
+ *  Forward error correction (fec_size > 0):
+ *  Reed-Solomon parity over raw payload, header and check, GF(256) 0x11D.
+ *  Receiver corrects up to fec_size / 2 damaged bytes before the check.
+ *  Damaged END, collision markers or COBS codes still drop the frame.
+ *  
+ *	[D n] [D n+1] [SIZE] [ID] [CRC8] [P 0] .. [P fec_size - 1] [END]
+ *	
+ *  Control byte:
+ *  Frame flags, sent before SIZE when any extension uses it.
+ *  SIZE keeps payload size without control byte.
+ *  
+ *  Compression (CONTROL_COMPRESSED):
+ *  LZSS over frame payload, window is the payload itself.
+ *  Each group starts with flags byte, bit per item LSB first:
+ *  0 - literal byte, 1 - match [OFFSET] [LENGTH - LZ_MATCH_SIZE_MIN].
+ *  Frame sent raw if compressed one is not shorter on the wire.
+ *  
+ *	[FLAGS] [L] [L] [L] [OFFSET] [LENGTH] [L] [CTRL] [SIZE] [ID] [CRC8] [END]
+ *	
+ *  Aggregation (CONTROL_AGGREGATED):
+ *  Payload holds records given to SPP_SendRecord, each with size prefix.
+ *  Receiver splits them back, one OUTPUT_PutRecord_ call per record.
+ *  Compression, if enabled, applies to the whole aggregated payload.
+ *  Records are scheduled as channel 0 input, ahead of its byte stream.
+ *  
+ *	[R0 SIZE] [R0 D0] [R0 D1] [R1 SIZE] [R1 D0] [CTRL] [SIZE] [ID] [CRC8] [END]
+ *	
+ *  Channels:
+ *  Channel ID kept in control byte high nibble, each channel has its own
+ *  input and output. Next frame takes input of the highest priority channel
+ *  that has any, channels of equal priority share link by weights.
+ *  Frame of channel receiver does not have is acknowledged and dropped.
+ *	
+ *  Flow control (CONTROL_CREDIT):
+ *  ACK carries receiver free FIFO space in bytes as one byte payload.
+ *  Sender never takes more input than last credit, zero credit stops it.
+ *  Receiver repeats ACK as window update when space freed or every 
+ *  TX_TIMEOUT while advertised credit is less than a frame.
+ *  
+ *	[CREDIT] [CTRL] [SIZE = HEADER_SIZE] [ID] [CRC8] [END]
+ *	
+ *  Transmit pacing (baud_rate > 0):
+ *  Token bucket refilled from TIME_GetMicros_ at line rate, capped at
+ *  pacing_latency worth of bytes. UART_PutByte_ called only while tokens
+ *  last, so driver queue never holds more than line drains in that time
+ *  and frame timeouts are not spent waiting in host buffers.
+ *	
+ *  Handshake (ID_HELLO):
+ *  Link starts in legacy format, no frames sent till settings agreed.
+ *  Hello always keeps legacy format with CRC8 seeded by HANDSHAKE_SEED,
+ *  so receivers without handshake drop it as broken.
+ *  Payload - [VERSION] [FLAGS] [CAPS] [BUFFER SIZE] [WINDOW] [FEC SIZE]
+ *  Hello is answered until peer reports HELLO_DONE, settings applied
+ *  on first hello with HELLO_SEEN (peer got ours):
+ *  COBS if shared, strongest check both allow, compression and flow
+ *  control if shared, smaller FEC and frames fitting both buffers.
+ *  Hello without HELLO_SEEN means peer restarted - frames wait again.
+ *  Silent peer is legacy one - no control byte, so records waiting are
+ *  dropped, SPP_SendRecord refused and only channel 0 input sent.
+ *  
+ *	[VERSION] [FLAGS] [CAPS] [BUFFER] [WINDOW] [FEC] [SIZE] [ID_HELLO] [CRC8] [END]
+ *	
+ *  Session (ID_RESET, ID_KEEPALIVE):
+ *  Empty frame with ID_RESET goes first after start and is repeated as
+ *  usual till ACKed. Receiver forgets last received ID, so new ID_MIN
+ *  is not a duplicate, and repeats its unacknowledged frame at once.
+ *  Link is in order and no frames follow unacknowledged reset, so 
+ *  repeated reset is harmless and needs no epoch number.
+ *  ACK with ID_KEEPALIVE is sent on idle line, any valid frame counts
+ *  as peer being alive. Peer back from silence gets pending frame at once.
+ *  
+ *	[SIZE = 0] [ID_RESET] [CRC8] [END]
+ *	
+ *  Bus (RS-485 multi-drop):
+ *  Raw address bytes go before encoded frame, never 0xFF, covered by check.
+ *  Receiver looks at DST only and skips the rest till END, so frames for
+ *  other nodes (own echo as well) cost no decoding and no check.
+ *  BUS_TOKEN in SRC marks the last item of the turn and hands line over:
+ *  ACK first, if any, then frame - new or repeated, as frame unacknowledged
+ *  by the end of peer turn is lost. Node with nothing to say sends 
+ *  ACK with ID_KEEPALIVE. Master polls slaves one by one, silent slave
+ *  loses its turn after bus_timeout.
+ *  
+ *	[DST] [SRC | TOKEN] [D n] [D n+1] [SIZE] [ID] [CRC8] [END]
+ *	
+ *  Block transmit and receive (DMA):
+ *  Two frame buffers. While frame N is on the wire or waits for ACK,
+ *  frame N+1 is encoded into the other one and sent right after the ACK.
+ *  Not done with flow control, credit for N+1 is known from ACK of N only.
+ *  Input of higher priority channel, come meanwhile, goes before N+1
+ *  with ID differing from both neighbours. Byte transmit encodes at once.
+ *  Received blocks are parsed till END in one handler call.
+ *	
+ *  Hub (many links in one process):
+ *  Callbacks, channels and settings kept once per hub, link holds pointer
+ *  and the format handshake agreed on. FEC generators are a const table.
+ *  Frame, ACK, receive and record buffers are pool blocks taken with first
+ *  byte and given back on ACK or when pushed out, so idle links own
+ *  no buffers. Free blocks form a stack, CAS on [tag] [index] head.
+ *  Link keeps 16-bit block indices, own buffers are offsets without pool.
+ *  State of handshake, session, bus and pacing is a block of its own,
+ *  taken by SPP_Init for links using any of them, link keeps hot state.
+ *  SSP_COMPACT drops embedded buffers, receive FIFO is a pool block too.
+ *  SSP_AGGREGATION, SSP_FLOW_CONTROL and SSP_DOUBLE_BUFFER set to 0 drop
+ *  record buffer, receive FIFO and second frame of links without pool,
+ *  such link can not use that feature.
+ *	
+ *  Send queue (SPP_Enqueue):
+ *  Any thread copies message into pool block and pushes it with CAS,
+ *  pushing needs no tag as head read is the only thing relied on.
+ *  QUEUE_POOL_RESERVE blocks are never queued, frames still get some.
+ *  Handler takes whole stack at once, reverses it to arrival order
+ *  and hands messages to aggregation, so boundaries are kept.
+ *	
+ *	[NEXT L] [NEXT H] [SIZE] [D0] .. [D n]
+ *	
+ *  Split handlers (SPP_RxHandler, SPP_TxHandler):
+ *  Receive and transmit halves may run in own threads or interrupts.
+ *  They share link fields only, each written by one half: receiver posts
+ *  ACK to send, ACK received and credits, transmitter posts ACKs sent
+ *  and credit advertised. Value is stored before its counter, reader
+ *  takes counter first, so newest value is seen at worst twice.
+ *  SPP_SendRecord and SPP_Flush belong to the transmit half.
+ *  SPP_Handler runs both in turn. Handshake and bus change settings
+ *  and line owner under both halves, such links use SPP_Handler only.
  *	
  */
 
 bool SPP_Init(ssp_str* const ssp, const ssp_init_str* const config)
 {
 	if( ssp
-	and config->CRC8_Function
-	and config->INPUT_GetByte_
-	and config->OUTPUT_PutByte_
-	and config->UART_GetByte_
-	and config->UART_PutByte_)
+	and (not config->bus or ((config->bus_address <= BUS_ADDRESS_MAX)
+						and (config->bus_peer <= BUS_ADDRESS_MAX)
+						and not config->handshake)))
 	{
 		memset(ssp, 0, sizeof(ssp_str));
 		
+		#if SSP_COMPACT
+		if(not config->hub or not config->pool) { return false; }
+		#else
+		if(not config->hub and not SPP_HubInit(&ssp->own.hub, config)) { return false; }
+		#endif
+		
+		ssp->hub = config->hub;
+		ssp->pool = config->pool;
+		
+		ssp->rx.buffer = POOL_NONE;
+		ssp->tx.ack.data = POOL_NONE;
+		ssp->tx.frame.data = POOL_NONE;
+		ssp->tx.next.data = POOL_NONE;
+		ssp->aggregation.data = POOL_NONE;
+		#if SSP_OWN_FIFO == 0
+		ssp->rx.fifo.data = POOL_NONE;
+		#endif
+		
+		#if SSP_COMPACT == 0
+		if(not config->hub) { ssp->hub = &ssp->own.hub; }
+		
+		// Own buffers are never given back, features without them need pool
+		#define OwnBlock(x) ((uint16_t)((uint8_t*)&ssp->own.x - (uint8_t*)&ssp->own))
+		if(not config->pool){
+			if((config->aggregation and not SSP_AGGREGATION)
+			or (config->flow_control and not SSP_FLOW_CONTROL)
+			or (ssp->hub->UART_PutBlock_ and not SSP_DOUBLE_BUFFER)) { return false; }
+			
+			ssp->rx.buffer = OwnBlock(rx);
+			ssp->tx.ack.data = OwnBlock(ack);
+			ssp->tx.frame.data = OwnBlock(frames[0]);
+			#if SSP_AGGREGATION
+			ssp->aggregation.data = OwnBlock(records);
+			#endif
+			#if SSP_DOUBLE_BUFFER
+			ssp->tx.next.data = OwnBlock(frames[1]);
+			#endif
+		}
+		#endif
+		
+		// Cold state only for features using it, held for good
+		ssp->cold = POOL_NONE;
+		if(config->handshake
+		or config->session
+		or config->bus
+		or ssp->hub->baud_rate
+		or ssp->hub->keepalive
+		or ssp->hub->dead_timeout)
+		{
+			#if SSP_COMPACT == 0
+			if(not config->pool) { ssp->cold = OwnBlock(cold); }
+			#endif
+			if(not TakeBlock_(ssp, &ssp->cold)) { return false; }
+		}
+		#undef OwnBlock
+		
+		ssp->framing = ssp->hub->framing;
+		ssp->check_type = ssp->hub->check_type;
+		ssp->check_size = check_size_table[ssp->hub->check_type];
+		ssp->fec_size = ssp->hub->fec_size;
+		
+		ssp->compression = config->compression;
+		ssp->control_size = (config->compression 
+							or config->aggregation 
+							or config->flow_control
+							or (ssp->hub->channels_count > 1))? CONTROL_SIZE : 0;
+		
+		// Peer assumed to have room for one frame till first ACK
+		ssp->flow_control = config->flow_control;
+		ssp->link.credit = CREDIT_MAX;
+		ssp->link.window = GetCredit_(ssp);
+		
+		ssp->aggregation.enabled = config->aggregation;
+		ssp->enabled.session = config->session;
+		ssp->enabled.bus = config->bus;
+		ssp->enabled.handshake = config->handshake;
+		
+		// Configured settings are the limit, legacy ones used till agreed
+		ssp->peer_buffer_size = BUFFER_TOTAL_SIZE;
+		
+		if(ssp->cold != POOL_NONE){
+			ssp_cold_str* cold = Cold_(ssp);
+			memset(cold, 0, sizeof(ssp_cold_str));
+			
+			cold->session.keepalive_timeout = ssp->hub->keepalive;
+			
+			// Master nodes start holding the token, SPP_MasterHandler picks one
+			cold->bus.master = config->bus_master;
+			cold->bus.token = config->bus_master;
+			cold->bus.address = config->bus_address;
+			cold->bus.peer = config->bus_peer;
+			
+			// Bucket starts full
+			if(ssp->hub->baud_rate){
+				cold->pacing.tokens = ssp->hub->pacing_depth;
+				cold->pacing.last_time = ssp->hub->TIME_GetMicros_();
+			}
+		}
+		
+		if(config->handshake){
+			uint8_t caps = 0;
+			if(ssp->hub->framing == SSP_FRAMING_COBS) { caps |= CAP_COBS; }
+			if(ssp->hub->check_type >= SSP_CHECK_CRC16) { caps |= CAP_CRC16; }
+			if(ssp->hub->check_type >= SSP_CHECK_CRC32C) { caps |= CAP_CRC32C; }
+			if(config->compression) { caps |= CAP_COMPRESSION; }
+			if(config->flow_control) { caps |= CAP_FLOW_CONTROL; }
+			if(config->aggregation or (ssp->hub->channels_count > 1)) { caps |= CAP_CONTROL; }
+			
+			Cold_(ssp)->handshake.caps = caps;
+			
+			ssp->framing = SSP_FRAMING_ESCAPE;
+			ssp->check_type = SSP_CHECK_CRC8;
+			ssp->check_size = CRC8_SIZE;
+			ssp->fec_size = 0;
+			ssp->compression = false;
+			ssp->flow_control = false;
+			ssp->control_size = 0;
+		}
+		
 		// No frame been sended before - ready to send next
 		ssp->tx.frame.ack_received = true;
+		
+		ssp->queue.head = POOL_NONE;
+		ssp->queue.first = POOL_NONE;
+		ssp->queue.last = POOL_NONE;
+		
+		return true;
+	}
+	else { return false; }
+}
 
-		ssp->CRC8_Function		= config->CRC8_Function;
-		ssp->INPUT_GetByte_		= config->INPUT_GetByte_;
-		ssp->OUTPUT_PutByte_	= config->OUTPUT_PutByte_;
-		ssp->UART_GetByte_		= config->UART_GetByte_;
-		ssp->UART_PutByte_		= config->UART_PutByte_;
+bool SPP_HubInit(ssp_hub_str* const hub, const ssp_init_str* const config)
+{
+	if( hub
+	and config->CRC8_Function
+	and (config->UART_GetByte_ or (config->UART_GetBlock_ and config->UART_ReleaseBlock_))
+	and (config->UART_PutByte_ or config->UART_PutBlock_)
+	and config->channels_count <= CHANNELS_MAX
+	and config->framing <= SSP_FRAMING_COBS
+	and config->check_type <= SSP_CHECK_CRC32C
+	and config->fec_size <= FEC_SIZE_MAX
+	and (config->TIME_GetMicros_ or not config->baud_rate))
+	{
+		memset(hub, 0, sizeof(ssp_hub_str));
+		
+		if(not InitChannels_(hub, config)) { return false; }
+		
+		hub->CRC8_Function		= config->CRC8_Function;
+		hub->OUTPUT_PutRecord_	= config->OUTPUT_PutRecord_;
+		hub->TIME_GetMicros_	= config->TIME_GetMicros_;
+		hub->UART_GetByte_		= config->UART_GetByte_;
+		hub->UART_PutByte_		= config->UART_PutByte_;
+		hub->UART_PutBlock_		= config->UART_PutBlock_;
+		hub->UART_GetBlock_		= config->UART_GetBlock_;
+		hub->UART_ReleaseBlock_	= config->UART_ReleaseBlock_;
+		
+		hub->framing			= config->framing;
+		hub->check_type			= config->check_type;
+		hub->fec_size			= config->fec_size;
+		hub->aggregation_fill	= config->aggregation_fill;
+		hub->aggregation_delay	= config->aggregation_delay;
+		hub->keepalive			= config->keepalive;
+		hub->dead_timeout		= config->dead_timeout;
+		hub->bus_timeout		= config->bus_timeout;
+		
+		// Bucket depth is atleast one byte
+		hub->baud_rate			= config->baud_rate;
+		if(hub->baud_rate){
+			hub->pacing_depth = MAX((uint64_t)config->baud_rate * config->pacing_latency, 
+									PACING_BYTE_COST);
+		}
 		
 		return true;
 	}
 	else { return false; }
 }
 
+bool SPP_PoolInit(ssp_pool_str* const pool, uint8_t (*blocks)[POOL_BLOCK_SIZE], uint16_t* next, uint16_t count)
+{
+	if(not pool or not blocks or not next or (count == 0) or (count >= POOL_NONE)) { return false; }
+	
+	// Blocks may hold link state
+	if((uintptr_t)blocks % POOL_BLOCK_ALIGN) { return false; }
+	
+	pool->blocks = blocks;
+	pool->next = next;
+	pool->count = count;
+	pool->available = count;
+	
+	// Each free block links to the next one
+	for(uint16_t i = 0; i < count; i++){
+		SetBlockNext_(pool, i, (i + 1 < count)? i + 1 : POOL_NONE);
+	}
+	pool->head = 0;
+	
+	return true;
+}
+
+uint16_t SPP_PoolAvailable(const ssp_pool_str* const pool)
+{
+	return AtomicLoad(&pool->available);
+}
+
+bool SPP_SendRecord(ssp_str* const ssp, const uint8_t* data, uint8_t size)
+{
+	if(not ssp->aggregation.enabled or (size == 0)) { return false; }
+	
+	// Record must fit into frame with all its collisions
+	uint8_t encoded_size = GetEncodedSize_(ssp, &size, RECORD_HEADER_SIZE)
+						 + GetEncodedSize_(ssp, data, size);
+	if(ssp->aggregation.encoded_size + encoded_size > GetInputSizeMax_(ssp)) { 
+		// Dont wait for more, when full
+		ssp->aggregation.flush = true;
+		return false; 
+	}
+	
+	// Delay counts from the first record, buffer taken with it
+	if(ssp->aggregation.size == 0) { 
+		if(not TakeBlock_(ssp, &ssp->aggregation.data)) { return false; }
+		ssp->aggregation.timeout = ssp->hub->aggregation_delay; 
+	}
+	
+	uint8_t* records = Block_(ssp, ssp->aggregation.data);
+	records[ssp->aggregation.size] = size;
+	memcpy(&records[ssp->aggregation.size + RECORD_HEADER_SIZE], data, size);
+	ssp->aggregation.size += RECORD_HEADER_SIZE + size;
+	ssp->aggregation.encoded_size += encoded_size;
+	
+	return true;
+}
+
+bool SPP_Enqueue(ssp_str* const ssp, const uint8_t* data, uint8_t size)
+{
+	// Only fields set once by SPP_Init are read here, and flag handshake
+	// may clear - queue is dropped by handler then
+	if(not AtomicLoadRelaxed(&ssp->aggregation.enabled) 
+	or not ssp->pool 
+	or (size == 0) 
+	or (size > QUEUE_MESSAGE_MAX)) { return false; }
+	
+	// Refused now if it may never fit a frame
+	if(not IsQueueFitting_(ssp, data, size)) { return false; }
+	
+	uint16_t index = PoolTake_(ssp->pool);
+	if(index == POOL_NONE) { return false; }
+	
+	// Blocks left for frames, or queued messages would starve the link.
+	// Count read after own take, so concurrent producers never all pass.
+	if(SPP_PoolAvailable(ssp->pool) < QUEUE_POOL_RESERVE){
+		PoolGive_(ssp->pool, index);
+		return false;
+	}
+	
+	uint8_t* block = ssp->pool->blocks[index];
+	block[QUEUE_SIZE_INDEX] = size;
+	memcpy(&block[QUEUE_HEADER_SIZE], data, size);
+	
+	uint16_t head = AtomicLoad(&ssp->queue.head);
+	do {
+		SetBlockNext_(ssp->pool, index, head);
+	} while(not AtomicCompareSwap(&ssp->queue.head, &head, index));
+	
+	return true;
+}
+
+void SPP_Flush(ssp_str* const ssp)
+{
+	if(ssp->aggregation.size) { ssp->aggregation.flush = true; }
+}
+
+void SPP_TransmitComplete(ssp_str* const ssp)
+{
+	// Called from DMA interrupt, handler picks it up
+	ssp->tx.block_complete = true;
+}
+
+bool SPP_IsPeerAlive(const ssp_str* const ssp)
+{
+	// Never dead without timeout, else not alive till first valid frame
+	return (ssp->hub->dead_timeout == 0) or Cold_(ssp)->session.alive;
+}
+
+void SPP_MasterHandler(ssp_master_str* const master)
+{
+	ssp_str* node = master->nodes[master->current];
+	SPP_Handler(node);
+	
+	// Slave answered or kept silent too long - poll next one
+	if(Cold_(node)->bus.turn_over){
+		Cold_(node)->bus.turn_over = false;
+		master->current = (master->current + 1) % master->count;
+		Cold_(master->nodes[master->current])->bus.token = true;
+	}
+}
+
 void SPP_Handler(ssp_str* const ssp)
 {
+	SPP_RxHandler(ssp);
+	SPP_TxHandler(ssp);
+}
+
+void SPP_RxHandler(ssp_str* const ssp)
+{
+	// Handler calls since last valid frame
+	if(ssp->hub->dead_timeout){
+		ssp_cold_str* cold = Cold_(ssp);
+		if(cold->session.silence < UINT16_MAX) { cold->session.silence++; }
+		if(cold->session.silence >= ssp->hub->dead_timeout) { cold->session.alive = false; }
+	}
+	
 	// Sending received data further
-	// Dont try to receive anything before it done
-	if(PushAllReceivedData(ssp))
+	// Dont try to receive anything before it done, unless buffered
+	bool is_pushed = PushAllReceivedData(ssp);
+	
+	if(is_pushed or ssp->flow_control)
 	switch(ReceptionHandler_(ssp)){
 		case ACK_RECEIVED:
-			// If awaiting ACK - check received
-			if(ssp->tx.timeout > 0){
-				// Allow next frame sending on match
-				if(ssp->tx.frame.id == ssp->rx.id){
-					ssp->tx.timeout = 0;
-					ssp->tx.frame.ack_received = true;
-				}
-			}
+			// Credit taken from any ACK, window update as well
+			if(ssp->rx.control & CONTROL_CREDIT) { AtomicStore(&ssp->link.credit, Block_(ssp, ssp->rx.buffer)[0]); }
+			
+			// Transmitter checks it against frame awaiting ACK
+			AtomicStore(&ssp->link.acked_id, ssp->rx.id);
+			AtomicStore(&ssp->link.acked, (uint8_t)(ssp->link.acked + 1));
+			
 			// We dont need ACK data to be pushed out.
 			ResetReceiver_(ssp);
+			SessionHeard_(ssp);
+			break;
+		
+		case HELLO_RECEIVED:
+			HandshakeReceived_(ssp);
+			ResetReceiver_(ssp);
+			SessionHeard_(ssp);
 			break;
 		
 		case FRAME_RECEIVED:
+			SessionHeard_(ssp);
+			
+			// Peer restarted - new IDs are not duplicates, 
+			// frame it lost is repeated at once
+			if(ssp->enabled.session and (ssp->rx.id == ID_RESET)){
+				ssp->rx.last_received_id = ID_NONE;
+				AtomicStore(&ssp->link.credit, CREDIT_MAX);
+				AtomicStore(&ssp->link.repeats, (uint8_t)(ssp->link.repeats + 1));
+				RequestAck_(ssp, ID_RESET);
+				ResetReceiver_(ssp);
+			}
+			// Buffered frame is moved out of receiver at once.
+			// No ACK if no room - sender repeats it later.
+			else if(ssp->flow_control){
+				if(ssp->rx.id != ssp->rx.last_received_id) {
+					if(BufferReceived_(ssp)) { ssp->rx.last_received_id = ssp->rx.id; }
+				}
+				if(ssp->rx.id == ssp->rx.last_received_id) { RequestAck_(ssp, ssp->rx.id); }
+				ResetReceiver_(ssp);
+			}
 			// If ready to ACK 
-			if(ssp->tx.ack.id == ID_NONE){
+			else if(not IsAckRequested_(ssp)){
 
 				// If new frame - remember ID
 				// and leave receiver state for pushing data further
@@ -134,8 +883,10 @@ void SPP_Handler(ssp_str* const ssp)
 				else { ResetReceiver_(ssp); }
 
 				// Always send ACK on successfully received frame
-				ssp->tx.ack.id = ssp->rx.id;
+				RequestAck_(ssp, ssp->rx.id);
 			}
+			// Previous ACK not out yet - sender repeats this one
+			else { ResetReceiver_(ssp); }
 			break;
 		
 		default:
@@ -152,215 +903,1745 @@ void SPP_Handler(ssp_str* const ssp)
 			break;
 	}
 	
+	// Line handed over by peer
+	if(ssp->enabled.bus and Cold_(ssp)->bus.token_received){
+		ssp_cold_str* cold = Cold_(ssp);
+		cold->bus.token_received = false;
+		cold->bus.timeout = 0;
+		if(cold->bus.master) { cold->bus.turn_over = true; }
+		else { cold->bus.token = true; }
+	}
+	
+	// Window update, when peer may wait for room
+	uint8_t advertised = AtomicLoad(&ssp->link.advertised);
+	if(ssp->flow_control
+	and not IsAckRequested_(ssp)
+	and(ssp->rx.last_received_id != ID_NONE)
+	and(advertised < GetInputSizeMax_(ssp)))
+	{
+		if(ssp->rx.update_timeout) { ssp->rx.update_timeout--; }
+		
+		if((GetCredit_(ssp) > advertised)
+		or (ssp->rx.update_timeout == 0))
+		{
+			RequestAck_(ssp, ssp->rx.last_received_id);
+		}
+	}
+	
+	// Free FIFO space for ACKs transmitter makes
+	AtomicStore(&ssp->link.window, GetCredit_(ssp));
+}
+
+void SPP_TxHandler(ssp_str* const ssp)
+{
+	ReadLink_(ssp);
+	DrainQueue_(ssp);
 	TransmissionHandler_(ssp);
 }
 
-static inline ssp_rx_answer_enum 
-ReceptionHandler_(ssp_str* ssp)
+static inline void 
+RequestAck_(ssp_str* ssp, uint8_t id)
 {
-	#define DecIndex()		{ssp->rx.index--; ssp->rx.index &= OVERFLOW_MASK;}
-	#define IncLocalIndex()	{local_index++; local_index &= OVERFLOW_MASK;}
-	
-	uint8_t received;
-	
-	// Leave if no new bytes in UART
-	if(not ssp->UART_GetByte_(&received)) { return NOTHING_RECEIVED; }
+	// ID first, transmitter takes it on counter change
+	AtomicStore(&ssp->link.ack_id, id);
+	AtomicStore(&ssp->link.ack_posted, (uint8_t)(ssp->link.ack_posted + 1));
+	ssp->rx.update_timeout = TX_TIMEOUT;
+}
 
-	// Recive till END_MARKER
-	if(received != END_MARKER){
-		ssp->rx.buffer[ssp->rx.index] = received;
-		ssp->rx.index++;
-		ssp->rx.index &= OVERFLOW_MASK;
-		return NOTHING_RECEIVED;
+static inline bool 
+IsAckRequested_(ssp_str* ssp)
+{
+	return AtomicLoad(&ssp->link.ack_sent) != ssp->link.ack_posted;
+}
+
+static inline void 
+ReadLink_(ssp_str* ssp)
+{
+	// Peer back from silence or restarted - pending frame repeated at once
+	uint8_t repeats = AtomicLoad(&ssp->link.repeats);
+	if(repeats != ssp->tx.seen.repeats){
+		ssp->tx.seen.repeats = repeats;
+		ssp->tx.timeout = 0;
 	}
-	// If END received
-	else {
-		DecIndex();	// Skip CRC8
-		ssp->rx.id = ssp->rx.buffer[ssp->rx.index];
-		DecIndex();
-		ssp->rx.size = ssp->rx.buffer[ssp->rx.index];
-		// Index wasnt decremented, cause needed in CRC8 calculation
-		
-		// WARRNING HEADER SIZE INCLUDES END MARKER
-		uint8_t payload_size = ssp->rx.size - HEADER_SIZE; 
-		// Getting payload zero index
-		uint8_t local_index = ssp->rx.index - payload_size;
-		local_index &= OVERFLOW_MASK;
-
-		// Push all payload to CRC8
-		ResetCRC8(ssp);
-		while(local_index < ssp->rx.index){ 
-			PushCRC8(ssp, ssp->rx.buffer[local_index]); 
-			IncLocalIndex();
-		}
-		PushCRC8(ssp, ssp->rx.buffer[local_index]); // Size to CRC8
-		IncLocalIndex();
-		PushCRC8(ssp, ssp->rx.buffer[local_index]); // ID to CRC8 
-		IncLocalIndex();
-		
-		// Index points to CRC8
-		if(ssp->rx.buffer[local_index] != GetCRC8(ssp)) { return BROKEN_RECEIVED; }
-			
-		// Index points to first data byte
-		ssp->rx.index -= payload_size;  
-		ssp->rx.index &= OVERFLOW_MASK;
+	
+	// If awaiting ACK - check received, next frame allowed on match.
+	// Bus turn may outlast timeout, frame is only repeated on next turn
+	uint8_t acked = AtomicLoad(&ssp->link.acked);
+	if(acked != ssp->tx.seen.acked){
+		ssp->tx.seen.acked = acked;
 		
-		// If ACK
-		if(payload_size == 0){ return ACK_RECEIVED; }
-		else { return FRAME_RECEIVED; }
+		if(((ssp->tx.timeout > 0) or ssp->enabled.bus)
+		and(ssp->tx.frame.id == AtomicLoad(&ssp->link.acked_id)))
+		{
+			ssp->tx.timeout = 0;
+			ssp->tx.frame.ack_received = true;
+			ReleaseFrame_(ssp);
+			if(ssp->tx.frame.id == ID_RESET) { Cold_(ssp)->session.established = true; }
+		}
 	}
 	
-	#undef DecIndex
-	#undef IncLocalIndex
+	// ACK asked by receiver, after the one being sent
+	uint8_t posted = AtomicLoad(&ssp->link.ack_posted);
+	if((ssp->tx.ack.id == ID_NONE) and (posted != ssp->tx.seen.ack)){
+		ssp->tx.seen.ack = posted;
+		ssp->tx.ack.id = AtomicLoad(&ssp->link.ack_id);
+	}
 }
 
-static inline bool 
-PushAllReceivedData(ssp_str* ssp)
+static inline ssp_rx_answer_enum 
+ReceptionHandler_(ssp_str* ssp)
 {
-	if(ssp->rx.index > ssp->rx.size){
+	uint8_t received;
+	
+	// Recive till END_MARKER
+	// Index stops at buffer size on overflow, frame will be dropped on END.
+	// Escape frame is found back from END, oldest bytes make room for it.
+	// Byte per call, block is taken till END at once
+	do {
+		// Leave if no new bytes in UART
+		if(not GetByte_(ssp, &received)) { return NOTHING_RECEIVED; }
+		if(received == END_MARKER) { break; }
 		
-		while(ssp->rx.index > ssp->rx.size) {
-
-			bool is_sended = ssp->OUTPUT_PutByte_(ssp->rx.buffer[ssp->rx.index]);
-			if(not is_sended) { return false; }
+		// Bus frame for other node skipped unseen
+		if(ssp->enabled.bus and (Cold_(ssp)->bus.prefix_index < BUS_PREFIX_SIZE)){
+			ssp_cold_str* cold = Cold_(ssp);
+			cold->bus.prefix[cold->bus.prefix_index++] = received;
+			
+			if((cold->bus.prefix[0] != cold->bus.address)
+			or((cold->bus.prefix_index == BUS_PREFIX_SIZE) 
+			and((received & ~BUS_TOKEN) != cold->bus.peer)))
+			{
+				ssp->rx.skip = true;
+			}
+		}
+		else if(ssp->rx.skip) { }
+		// Buffer taken with first byte, no buffer - frame lost
+		else if(not TakeBlock_(ssp, &ssp->rx.buffer)) { ssp->rx.skip = true; }
+		else if(ssp->rx.index < BUFFER_TOTAL_SIZE){
+			Block_(ssp, ssp->rx.buffer)[ssp->rx.index] = received;
 			ssp->rx.index++;
-			ssp->rx.index &= OVERFLOW_MASK;
 		}
+		else if(ssp->framing == SSP_FRAMING_ESCAPE){
+			uint8_t* buffer = Block_(ssp, ssp->rx.buffer);
+			memmove(buffer, &buffer[1], BUFFER_TOTAL_SIZE - 1);
+			buffer[BUFFER_TOTAL_SIZE - 1] = received;
+		}
+	} while(ssp->hub->UART_GetBlock_);
+	
+	if(received != END_MARKER) { return NOTHING_RECEIVED; }
+	
+	// If END received
+	uint8_t size = ssp->rx.index;
+	ssp->rx.index = 0;
+	
+	bool is_skipped = ssp->rx.skip;
+	if(ssp->enabled.bus){
+		is_skipped = is_skipped or (Cold_(ssp)->bus.prefix_index < BUS_PREFIX_SIZE);
+		Cold_(ssp)->bus.prefix_index = 0;
+	}
+	ssp->rx.skip = false;
+	if(is_skipped) { return NOTHING_RECEIVED; }
 
-		// When everything pushed out
+	if(size == 0) { return BROKEN_RECEIVED; }
+	if((size == BUFFER_TOTAL_SIZE) and (ssp->framing != SSP_FRAMING_ESCAPE)) { return BROKEN_RECEIVED; }
+	
+	uint8_t* buffer = Block_(ssp, ssp->rx.buffer);
+	
+	// Hello keeps legacy format whatever link settings are
+	if(ssp->enabled.handshake and IsHello_(ssp, size)){
+		size -= TRAILER_SIZE;
+		if(not DecodeEscaped_(buffer, &size) or (size != HELLO_SIZE)) { return BROKEN_RECEIVED; }
+		return HELLO_RECEIVED;
+	}
+
+	// Frame decoded before parsing, check covers raw bytes.
+	// Legacy frame decoded after, check covers escaped bytes.
+	if(ssp->framing == SSP_FRAMING_COBS){
+		if(not DecodeCOBS_(buffer, &size)) { return BROKEN_RECEIVED; }
+	}
+	else if(not IsLegacyFrame(ssp)){
+		if(not DecodeEscaped_(buffer, &size)) { return BROKEN_RECEIVED; }
+	}
+	
+	// Previous frame may be ahead, if its END was damaged
+	if(ssp->framing == SSP_FRAMING_ESCAPE){
+		if(not LocateEscaped_(ssp, &size)) { return BROKEN_RECEIVED; }
+	}
+	
+	// Parity stripped after correction
+	if(ssp->fec_size){
+		if(size < ssp->fec_size) { return BROKEN_RECEIVED; }
+		if(not FecCorrect_(ssp, buffer, size)) { return BROKEN_RECEIVED; }
+		size -= ssp->fec_size;
+	}
+	
+	const uint8_t trailer_size = TRAILER_SIZE - CRC8_SIZE + ssp->check_size + ssp->control_size;
+	if(size < trailer_size) { return BROKEN_RECEIVED; }
+	
+	uint8_t payload_size = size - trailer_size;
+	uint8_t index = payload_size;
+	
+	ssp->rx.control = 0;
+	if(ssp->control_size) { ssp->rx.control = buffer[index++]; }
+	
+	uint8_t header_size = buffer[index++];
+	ssp->rx.id = buffer[index++];
+	
+	// ACK has no payload, but credit, and HEADER_SIZE in size field
+	bool is_ack = (header_size == HEADER_SIZE)
+			  and((payload_size == 0)
+			  or ((payload_size == CREDIT_SIZE) and (ssp->rx.control & CONTROL_CREDIT)));
+	if(not is_ack and (header_size != payload_size)) { return BROKEN_RECEIVED; }
+	
+	if(not IsCheckValid_(ssp, buffer, index)) { return BROKEN_RECEIVED; }
+	
+	if(ssp->enabled.bus and (Cold_(ssp)->bus.prefix[1] & BUS_TOKEN)) { Cold_(ssp)->bus.token_received = true; }
+	
+	if(is_ack) { return ACK_RECEIVED; }
+	
+	// Unknown channel - ACKed, so sender goes on, payload dropped
+	uint8_t channel = ssp->rx.control >> CONTROL_CHANNEL_SHIFT;
+	if((channel >= ssp->hub->channels_count)
+	or(ssp->hub->channel[channel].OUTPUT_PutByte_ == NULL)) {
+		ssp->rx.control = 0;
 		ResetReceiver_(ssp);
+		return FRAME_RECEIVED;
 	}
 	
-	return true;
-}
-
-static inline bool 
-PushAllToOutput_(ssp_str* ssp)
-{
-	if(ssp->tx.counter < ssp->tx.size){
+	// Collisions resolved in place, after check
+	if(IsLegacyFrame(ssp)){
+		if(not DecodeEscaped_(buffer, &payload_size)) { return BROKEN_RECEIVED; }
+	}
+	
+	if(ssp->rx.control & CONTROL_COMPRESSED){
+		uint8_t raw[PAYLOAD_SIZE_MAX];
+		payload_size = Decompress_(buffer, payload_size, raw, sizeof(raw));
+		if(payload_size == 0) { return BROKEN_RECEIVED; }
+		memcpy(buffer, raw, payload_size);
+	}
+	
+	// Records must cover payload exactly
+	if(ssp->rx.control & CONTROL_AGGREGATED){
+		uint16_t i = 0;
+		while(i < payload_size) { i += RECORD_HEADER_SIZE + buffer[i]; }
+		if(i != payload_size) { return BROKEN_RECEIVED; }
 		
-		while(ssp->tx.counter < ssp->tx.size) {
-			bool is_sended = ssp->UART_PutByte_(ssp->tx.data[ssp->tx.counter]);
-			if(is_sended) { ssp->tx.counter++; }
-			else { return false; }
+		// Without record output records are pushed as bytes
+		if(not ssp->hub->OUTPUT_PutRecord_){
+			uint8_t size = 0;
+			for(i = 0; i < payload_size; i += RECORD_HEADER_SIZE + buffer[i]){
+				memmove(&buffer[size], &buffer[i + RECORD_HEADER_SIZE], buffer[i]);
+				size += buffer[i];
+			}
+			payload_size = size;
 		}
-		
-		// Mark as sended and start timeout counting, if needed.
-		if(ssp->tx.size == HEADER_SIZE){ ssp->tx.ack.id = ID_NONE; }
-		else { ssp->tx.timeout = TX_TIMEOUT; }
 	}
 	
-	return true;
+	// Leave receiver ready for pushing payload further
+	ssp->rx.size = payload_size;
+	return FRAME_RECEIVED;
 }
 
-
-
 static inline bool 
-TransmissionHandler_(ssp_str* ssp)
+LocateEscaped_(ssp_str* ssp, uint8_t* size)
 {
-	// Send all first
-	if(not PushAllToOutput_(ssp)){ return false; }
-		
-	// Timeout decounter (counts only if transmission complete)
-	if(ssp->tx.timeout) { ssp->tx.timeout--; }
+	// [CTRL] [SIZE] [ID] [CHECK] [PARITY] at fixed places back from END
+	const uint8_t tail_size = TRAILER_SIZE - CRC8_SIZE + ssp->check_size + ssp->fec_size;
+	if(*size < tail_size + ssp->control_size) { return false; }
 	
-	// If ack needed
-	if(ssp->tx.ack.id > ID_NONE) {
-		CreateAck_(ssp, ssp->tx.ack.id);
-		SetupTransmitterForAck_(ssp);
+	uint8_t* buffer = Block_(ssp, ssp->rx.buffer);
+	uint8_t payload_size = buffer[*size - tail_size];
+	uint8_t control = ssp->control_size? buffer[*size - tail_size - 1] : 0;
+	
+	// ACK with credit. Without it ACK and frame of HEADER_SIZE payload
+	// share SIZE, ACK taken if frame does not hold and ACK does.
+	if((payload_size == HEADER_SIZE) and (control & CONTROL_CREDIT)) { payload_size = CREDIT_SIZE; }
+	else if(payload_size == HEADER_SIZE){
+		const uint8_t ack_size = ssp->control_size + tail_size;
+		const uint8_t data_size = HEADER_SIZE + ack_size;
+		bool is_frame = (data_size <= *size) and IsEscapedValid_(ssp, &buffer[*size - data_size], data_size);
+		if(not is_frame and IsEscapedValid_(ssp, &buffer[*size - ack_size], ack_size)) { payload_size = 0; }
 	}
-	// If timeout expires
-	else if(ssp->tx.timeout == 0) {
-		// Send new parcel
-		if(ssp->tx.frame.ack_received){
-			if(CreateFrame_(ssp)) { SetupTransmitterForFrame_(ssp); }
-		}
-		// Repeat
-		else { SetupTransmitterForFrame_(ssp); }
+	
+	uint8_t frame_size = payload_size + ssp->control_size + tail_size;
+	if(frame_size >= *size) { return true; }
+	uint8_t* frame = &buffer[*size - frame_size];
+	
+	// SIZE may be the damaged byte, parity is tried on whole buffer then
+	uint8_t corrected[BUFFER_TOTAL_SIZE];
+	if(ssp->fec_size){
+		memcpy(corrected, frame, frame_size);
+		if(not FecCorrect_(ssp, corrected, frame_size)) { return true; }
+		frame = corrected;
 	}
 	
+	memmove(buffer, frame, frame_size);
+	*size = frame_size;
 	return true;
 }
 
-static inline void 
-CreateAck_(ssp_str* ssp, uint8_t id_to_ack)
+static inline bool 
+IsEscapedValid_(ssp_str* ssp, const uint8_t* frame, uint8_t size)
 {
-	ResetCRC8(ssp);
-	PushCRC8(ssp, HEADER_SIZE);
-	PushCRC8(ssp, id_to_ack);
-	ssp->tx.ack.size = HEADER_SIZE;
-	ssp->tx.ack.id = id_to_ack;
-	ssp->tx.ack.crc8 = GetCRC8(ssp);
+	// Candidate corrected on a copy, buffer left as it is
+	uint8_t corrected[BUFFER_TOTAL_SIZE];
+	if(ssp->fec_size){
+		memcpy(corrected, frame, size);
+		if(not FecCorrect_(ssp, corrected, size)) { return false; }
+		frame = corrected;
+		size -= ssp->fec_size;
+	}
+	
+	return IsCheckValid_(ssp, frame, size - ssp->check_size);
+}
+
+static inline bool 
+IsCheckValid_(ssp_str* ssp, const uint8_t* data, uint8_t index)
+{
+	// Check at index covers address and everything before it.
+	// Own accumulator, transmitter may be encoding meanwhile
+	uint32_t check = 0;
+	for(uint8_t i = 0; i < ssp->check_size; i++){
+		check |= (uint32_t)data[index + i] << (8 * i);
+	}
+	
+	uint32_t expected_check = CheckSeed_(ssp);
+	if(ssp->enabled.bus) { expected_check = CheckBlock_(ssp, Cold_(ssp)->bus.prefix, BUS_PREFIX_SIZE, expected_check); }
+	expected_check = CheckFinal_(ssp, CheckBlock_(ssp, data, index, expected_check));
+	
+	// CRC8 collision handling
+	if(IsLegacyFrame(ssp) and (expected_check == END_MARKER)) {
+		expected_check = COLLISION_MARKER;
+	}
+	
+	return check == expected_check;
+}
+
+static inline bool 
+PushAllReceivedData(ssp_str* ssp)
+{
+	if(ssp->flow_control) { return PushAllBuffered_(ssp); }
+	
+	if((ssp->rx.control & CONTROL_AGGREGATED)
+	and(ssp->hub->OUTPUT_PutRecord_))
+	{
+		return PushAllReceivedRecords_(ssp);
+	}
+	
+	if(ssp->rx.index < ssp->rx.size){
+		
+		const uint8_t* buffer = Block_(ssp, ssp->rx.buffer);
+		while(ssp->rx.index < ssp->rx.size) {
+
+			uint8_t channel = ssp->rx.control >> CONTROL_CHANNEL_SHIFT;
+			bool is_sended = ssp->hub->channel[channel].OUTPUT_PutByte_(buffer[ssp->rx.index]);
+			if(not is_sended) { return false; }
+			ssp->rx.index++;
+		}
+
+		// When everything pushed out
+		ResetReceiver_(ssp);
+	}
+	
+	return true;
+}
+
+static inline bool 
+PushAllReceivedRecords_(ssp_str* ssp)
+{
+	if(ssp->rx.index < ssp->rx.size){
+		
+		const uint8_t* buffer = Block_(ssp, ssp->rx.buffer);
+		while(ssp->rx.index < ssp->rx.size) {
+			
+			uint8_t size = buffer[ssp->rx.index];
+			bool is_sended = ssp->hub->OUTPUT_PutRecord_(&buffer[ssp->rx.index + RECORD_HEADER_SIZE], size);
+			if(not is_sended) { return false; }
+			ssp->rx.index += RECORD_HEADER_SIZE + size;
+		}
+		
+		// When everything pushed out
+		ResetReceiver_(ssp);
+	}
+	
+	return true;
+}
+
+static inline bool 
+PushAllBuffered_(ssp_str* ssp)
+{
+	#define FifoPeek(offset) (fifo[(ssp->rx.fifo.head + (offset)) % RX_FIFO_SIZE])
+	#define FifoPop(size) {ssp->rx.fifo.head = (ssp->rx.fifo.head + (size)) % RX_FIFO_SIZE; \
+						   ssp->rx.fifo.count -= (size);}
+	
+	// Empty FIFO has no block
+	if(ssp->rx.fifo.count == 0) { return true; }
+	const uint8_t* fifo = Fifo_(ssp);
+	
+	while(ssp->rx.fifo.count){
+		
+		// Next frame - [CONTROL] [SIZE] [PAYLOAD]
+		if(ssp->rx.fifo.remaining == 0){
+			ssp->rx.fifo.control = FifoPeek(0);
+			ssp->rx.fifo.remaining = FifoPeek(1);
+			FifoPop(RX_FIFO_ENTRY_HEADER);
+			continue;
+		}
+		
+		if((ssp->rx.fifo.control & CONTROL_AGGREGATED)
+		and(ssp->hub->OUTPUT_PutRecord_))
+		{
+			// Record may be wrapped in FIFO
+			uint8_t record[PAYLOAD_SIZE_MAX];
+			uint8_t size = FifoPeek(0);
+			for(uint8_t i = 0; i < size; i++){ record[i] = FifoPeek(RECORD_HEADER_SIZE + i); }
+			
+			if(not ssp->hub->OUTPUT_PutRecord_(record, size)) { return false; }
+			FifoPop(RECORD_HEADER_SIZE + size);
+			ssp->rx.fifo.remaining -= RECORD_HEADER_SIZE + size;
+		}
+		else {
+			uint8_t channel = ssp->rx.fifo.control >> CONTROL_CHANNEL_SHIFT;
+			if(not ssp->hub->channel[channel].OUTPUT_PutByte_(FifoPeek(0))) { return false; }
+			FifoPop(1);
+			ssp->rx.fifo.remaining--;
+		}
+	}
+	
+	#if SSP_OWN_FIFO == 0
+	GiveBlock_(ssp, &ssp->rx.fifo.data);
+	#endif
+	return true;
+	
+	#undef FifoPeek
+	#undef FifoPop
+}
+
+static inline bool 
+BufferReceived_(ssp_str* ssp)
+{
+	if(ssp->rx.size + RX_FIFO_ENTRY_HEADER > RX_FIFO_SIZE - ssp->rx.fifo.count) { return false; }
+	
+	#if SSP_OWN_FIFO == 0
+	if(not TakeBlock_(ssp, &ssp->rx.fifo.data)) { return false; }
+	#endif
+	
+	uint16_t tail = (ssp->rx.fifo.head + ssp->rx.fifo.count) % RX_FIFO_SIZE;
+	uint8_t* fifo = Fifo_(ssp);
+	
+	#define FifoPush(x) {fifo[tail] = x; tail = (tail + 1) % RX_FIFO_SIZE; \
+						 ssp->rx.fifo.count++;}
+	
+	FifoPush(ssp->rx.control);
+	FifoPush(ssp->rx.size);
+	
+	// Dropped payload has no buffer
+	if(ssp->rx.size){
+		const uint8_t* buffer = Block_(ssp, ssp->rx.buffer);
+		for(uint8_t i = 0; i < ssp->rx.size; i++){ FifoPush(buffer[i]); }
+	}
+	
+	return true;
+	
+	#undef FifoPush
+}
+
+static inline uint8_t* 
+Fifo_(const ssp_str* ssp)
+{
+	#if SSP_OWN_FIFO
+	return (uint8_t*)ssp->rx.fifo.data;
+	#else
+	return Block_(ssp, ssp->rx.fifo.data);
+	#endif
+}
+
+static inline uint8_t 
+GetCredit_(ssp_str* ssp)
+{
+	uint16_t free = RX_FIFO_SIZE - ssp->rx.fifo.count;
+	if(free <= RX_FIFO_ENTRY_HEADER) { return 0; }
+	else { return MIN(free - RX_FIFO_ENTRY_HEADER, CREDIT_MAX); }
+}
+
+static inline bool 
+GetByte_(ssp_str* ssp, uint8_t* value)
+{
+	if(not ssp->hub->UART_GetBlock_) { return ssp->hub->UART_GetByte_(value); }
+	
+	if(ssp->rx.block == NULL){
+		ssp->rx.block = ssp->hub->UART_GetBlock_(&ssp->rx.block_size);
+		ssp->rx.block_index = 0;
+		if(ssp->rx.block == NULL) { return false; }
+	}
+	
+	bool is_taken = (ssp->rx.block_index < ssp->rx.block_size);
+	if(is_taken) { *value = ssp->rx.block[ssp->rx.block_index++]; }
+	
+	// Parsed - buffer back to DMA
+	if(ssp->rx.block_index == ssp->rx.block_size){
+		ssp->hub->UART_ReleaseBlock_(ssp->rx.block);
+		ssp->rx.block = NULL;
+	}
+	
+	return is_taken;
+}
+
+static inline bool 
+PutBlock_(ssp_str* ssp)
+{
+	// Buffer belongs to engine till completion
+	if(not ssp->tx.block_busy){
+		ssp->tx.block_complete = false;
+		const uint8_t* data = Block_(ssp, ssp->tx.data);
+		if(not ssp->hub->UART_PutBlock_(&data[ssp->tx.counter], ssp->tx.size - ssp->tx.counter)) {
+			return false; 
+		}
+		ssp->tx.block_busy = true;
+	}
+	
+	if(not ssp->tx.block_complete) { return false; }
+	
+	ssp->tx.block_busy = false;
+	ssp->tx.counter = ssp->tx.size;
+	return true;
+}
+
+static inline bool 
+PushAllToOutput_(ssp_str* ssp)
+{
+	if(ssp->tx.counter < ssp->tx.size){
+		
+		// Bucket is in cold state, there only with pacing
+		ssp_cold_str* cold = ssp->hub->baud_rate? Cold_(ssp) : NULL;
+		
+		if(ssp->hub->UART_PutBlock_){
+			if(not PutBlock_(ssp)) { return false; }
+		}
+		else if(cold) { PacingRefill_(ssp, cold); }
+		
+		const uint8_t* data = Block_(ssp, ssp->tx.data);
+		while(ssp->tx.counter < ssp->tx.size) {
+			// Line is busy with what driver already holds
+			if(cold) {
+				if(cold->pacing.tokens < PACING_BYTE_COST) { return false; }
+			}
+			
+			bool is_sended = ssp->hub->UART_PutByte_(data[ssp->tx.counter]);
+			if(is_sended) { 
+				ssp->tx.counter++; 
+				if(cold) { cold->pacing.tokens -= PACING_BYTE_COST; }
+			}
+			else { return false; }
+		}
+		
+		// Mark as sended and start timeout counting, if needed.
+		if(ssp->tx.data == ssp->tx.ack.data){ 
+			ssp->tx.ack.id = ID_NONE; 
+			AtomicStore(&ssp->link.ack_sent, ssp->tx.seen.ack);
+			GiveBlock_(ssp, &ssp->tx.ack.data);
+		}
+		else { 
+			ssp->tx.timeout = TX_TIMEOUT; 
+			if(ssp->tx.frame.ack_received) { GiveBlock_(ssp, &ssp->tx.frame.data); }
+		}
+		if(ssp->hub->keepalive) { Cold_(ssp)->session.keepalive_timeout = ssp->hub->keepalive; }
+	}
+	
+	return true;
+}
+
+
+static inline void 
+PacingRefill_(ssp_str* ssp, ssp_cold_str* cold)
+{
+	// Unsigned difference survives clock wrap
+	uint32_t now = ssp->hub->TIME_GetMicros_();
+	uint32_t elapsed = now - cold->pacing.last_time;
+	cold->pacing.last_time = now;
+	
+	cold->pacing.tokens += (uint64_t)elapsed * ssp->hub->baud_rate;
+	if(cold->pacing.tokens > ssp->hub->pacing_depth) { cold->pacing.tokens = ssp->hub->pacing_depth; }
+}
+
+static inline bool 
+TransmissionHandler_(ssp_str* ssp)
+{
+	// Send all first, next frame encoded meanwhile
+	bool is_sended = PushAllToOutput_(ssp);
+	PrepareNext_(ssp);
+	if(not is_sended){ return false; }
+		
+	// Timeout decounter (counts only if transmission complete)
+	if(ssp->tx.timeout) { ssp->tx.timeout--; }
+	if(ssp->aggregation.timeout) { ssp->aggregation.timeout--; }
+	if(ssp->cold != POOL_NONE){
+		ssp_cold_str* cold = Cold_(ssp);
+		if(cold->handshake.timeout) { cold->handshake.timeout--; }
+		if(cold->session.keepalive_timeout) { cold->session.keepalive_timeout--; }
+		if(cold->bus.timeout) { cold->bus.timeout--; }
+	}
+	
+	if(ssp->enabled.bus) {
+		BusTransmit_(ssp);
+		return true;
+	}
+	
+	// Idle line - let peer know we are here
+	if(ssp->hub->keepalive
+	and(Cold_(ssp)->session.keepalive_timeout == 0)
+	and(ssp->tx.ack.id == ID_NONE))
+	{
+		ssp->tx.ack.id = ID_KEEPALIVE;
+	}
+	
+	// If ack needed, it waits for a block with frames
+	if(ssp->tx.ack.id > ID_NONE) {
+		if(CreateAck_(ssp, ssp->tx.ack.id)) { SetupTransmitterForAck_(ssp); }
+	}
+	// No frames till link settings agreed
+	else if(ssp->enabled.handshake and not HandshakeTransmit_(ssp)) { }
+	// If timeout expires
+	else if(ssp->tx.timeout == 0) {
+		if(PrepareFrame_(ssp)) { SetupTransmitterForFrame_(ssp); }
+	}
+	
+	return true;
+}
+
+static inline bool 
+PrepareFrame_(ssp_str* ssp)
+{
+	// Repeat
+	if(not ssp->tx.frame.ack_received) { return true; }
+	
+	// Already encoded one, unless more urgent input came meanwhile
+	if(ssp->tx.next_ready){
+		if(not CreateUrgent_(ssp)){
+			SwapFrames_(ssp);
+			ssp->tx.next_ready = false;
+		}
+		ssp->tx.frame.ack_received = false;
+		return true;
+	}
+	
+	// Buffer held till ACK
+	if(not TakeBlock_(ssp, &ssp->tx.frame.data)) { return false; }
+	
+	// Reset before any new parcel
+	if(ssp->enabled.session and not Cold_(ssp)->session.established){
+		EncodeFrame_(ssp, NULL, 0, 0, ID_RESET);
+	}
+	// Send new parcel
+	else if(not CreateFrame_(ssp)) { 
+		GiveBlock_(ssp, &ssp->tx.frame.data);
+		return false; 
+	}
+	
+	ssp->tx.frame.ack_received = false;
+	return true;
+}
+
+static inline void 
+PrepareNext_(ssp_str* ssp)
+{
+	// Only while current one is out, its ID is the base for the next.
+	// Byte transmit encodes right before sending, nothing to overlap.
+	if(ssp->tx.next_ready
+	or ssp->tx.frame.ack_received
+	or ssp->flow_control
+	or not ssp->hub->UART_PutBlock_) { return; }
+	
+	SwapFrames_(ssp);
+	ssp->tx.frame.id = ssp->tx.next.id;
+	if(TakeBlock_(ssp, &ssp->tx.frame.data)){
+		ssp->tx.next_ready = CreateFrame_(ssp);
+		if(not ssp->tx.next_ready) { GiveBlock_(ssp, &ssp->tx.frame.data); }
+	}
+	SwapFrames_(ssp);
+}
+
+static inline bool 
+CreateUrgent_(ssp_str* ssp)
+{
+	// Nothing goes before top priority
+	if(ssp->tx.next.priority == 0) { return false; }
+	if(not TakeBlock_(ssp, &ssp->tx.frame.data)) { return false; }
+	
+	// New ID differs from the last sent and the encoded one
+	if(GenerateNewID_(ssp->tx.frame.id) == ssp->tx.next.id) { ssp->tx.frame.id = ssp->tx.next.id; }
+	if(CreateFrameAbove_(ssp, ssp->tx.next.priority)) { return true; }
+	
+	GiveBlock_(ssp, &ssp->tx.frame.data);
+	return false;
+}
+
+static inline void 
+SwapFrames_(ssp_str* ssp)
+{
+	ssp_frame_str frame = ssp->tx.frame;
+	ssp->tx.frame = ssp->tx.next;
+	ssp->tx.next = frame;
+}
+
+static inline void 
+ReleaseFrame_(ssp_str* ssp)
+{
+	// Late ACK of frame being repeated - given back when sent
+	if((ssp->tx.data == ssp->tx.frame.data) and (ssp->tx.counter < ssp->tx.size)) { return; }
+	GiveBlock_(ssp, &ssp->tx.frame.data);
+}
+
+static inline uint8_t* 
+Block_(const ssp_str* ssp, uint16_t block)
+{
+	#if SSP_COMPACT
+	return ssp->pool->blocks[block];
+	#else
+	// Own buffer is offset into own part of link
+	if(ssp->pool) { return ssp->pool->blocks[block]; }
+	return (uint8_t*)&ssp->own + block;
+	#endif
+}
+
+static inline ssp_cold_str* 
+Cold_(const ssp_str* ssp)
+{
+	return (ssp_cold_str*)Block_(ssp, ssp->cold);
+}
+
+static inline bool 
+TakeBlock_(ssp_str* ssp, uint16_t* block)
+{
+	// Own buffers are always there, missing one without pool stays so
+	if((*block == POOL_NONE) and ssp->pool) { *block = PoolTake_(ssp->pool); }
+	return (*block != POOL_NONE);
+}
+
+static inline void 
+GiveBlock_(ssp_str* ssp, uint16_t* block)
+{
+	if(ssp->pool and (*block != POOL_NONE)){
+		PoolGive_(ssp->pool, *block);
+		*block = POOL_NONE;
+	}
+}
+
+static inline uint16_t 
+PoolTake_(ssp_pool_str* pool)
+{
+	uint32_t head = AtomicLoad(&pool->head);
+	uint32_t new_head;
+	uint16_t index;
+	
+	// Next index may be stale if block is taken meanwhile, tag fails CAS then
+	do {
+		index = head & POOL_INDEX_MASK;
+		if(index == POOL_NONE) { return POOL_NONE; }
+		
+		new_head = ((head & ~(uint32_t)POOL_INDEX_MASK) + POOL_TAG_STEP) | GetBlockNext_(pool, index);
+	} while(not AtomicCompareSwap(&pool->head, &head, new_head));
+	
+	AtomicAdd(&pool->available, -1);
+	return index;
+}
+
+static inline void 
+PoolGive_(ssp_pool_str* pool, uint16_t index)
+{
+	uint32_t head = AtomicLoad(&pool->head);
+	uint32_t new_head;
+	
+	do {
+		SetBlockNext_(pool, index, head & POOL_INDEX_MASK);
+		new_head = ((head & ~(uint32_t)POOL_INDEX_MASK) + POOL_TAG_STEP) | index;
+	} while(not AtomicCompareSwap(&pool->head, &head, new_head));
+	
+	AtomicAdd(&pool->available, 1);
+}
+
+static inline uint16_t 
+GetBlockNext_(const ssp_pool_str* pool, uint16_t index)
+{
+	// Ordered by CAS on head, atomic only for stale reads of takers
+	return AtomicLoadRelaxed(&pool->next[index]);
+}
+
+static inline void 
+SetBlockNext_(ssp_pool_str* pool, uint16_t index, uint16_t next)
+{
+	AtomicStoreRelaxed(&pool->next[index], next);
+}
+
+static inline void 
+DrainQueue_(ssp_str* ssp)
+{
+	// Newest first on the stack - reversed to the end of own list
+	if(ssp->pool and (AtomicLoad(&ssp->queue.head) != POOL_NONE)){
+		uint16_t stack = AtomicLoad(&ssp->queue.head);
+		while(not AtomicCompareSwap(&ssp->queue.head, &stack, POOL_NONE)) { }
+		
+		uint16_t reversed = POOL_NONE;
+		uint16_t last = stack;
+		while(stack != POOL_NONE){
+			uint16_t next = GetBlockNext_(ssp->pool, stack);
+			SetBlockNext_(ssp->pool, stack, reversed);
+			reversed = stack;
+			stack = next;
+		}
+		
+		if(ssp->queue.first == POOL_NONE) { ssp->queue.first = reversed; }
+		else { SetBlockNext_(ssp->pool, ssp->queue.last, reversed); }
+		ssp->queue.last = last;
+	}
+	
+	while(ssp->queue.first != POOL_NONE){
+		uint16_t index = ssp->queue.first;
+		const uint8_t* block = ssp->pool->blocks[index];
+		uint8_t size = block[QUEUE_SIZE_INDEX];
+		const uint8_t* data = &block[QUEUE_HEADER_SIZE];
+		
+		// Wait for room, unless it never fits a frame or link sends
+		// no records at all - dropped then
+		if(not SPP_SendRecord(ssp, data, size)){
+			uint8_t encoded_size = GetEncodedSize_(ssp, &size, RECORD_HEADER_SIZE)
+								 + GetEncodedSize_(ssp, data, size);
+			if(ssp->aggregation.enabled and (encoded_size <= GetInputSizeMax_(ssp))) { break; }
+		}
+		
+		ssp->queue.first = GetBlockNext_(ssp->pool, ssp->queue.first);
+		if(ssp->queue.first == POOL_NONE) { ssp->queue.last = POOL_NONE; }
+		PoolGive_(ssp->pool, index);
+	}
+}
+
+static inline void 
+BusTransmit_(ssp_str* ssp)
+{
+	ssp_cold_str* cold = Cold_(ssp);
+	
+	// Last item of the turn is out - line belongs to peer
+	if(cold->bus.final_sent){
+		cold->bus.final_sent = false;
+		cold->bus.token = false;
+		cold->bus.timeout = ssp->hub->bus_timeout;
+		return;
+	}
+	
+	if(not cold->bus.token){
+		// Slave silent - its turn is over
+		if(cold->bus.master and (cold->bus.timeout == 0)) { cold->bus.turn_over = true; }
+		return;
+	}
+	
+	// ACK is out, frame goes last
+	if(cold->bus.frame_ready){
+		cold->bus.frame_ready = false;
+		cold->bus.final_sent = true;
+		SetupTransmitterForFrame_(ssp);
+		return;
+	}
+	
+	// Turn start. Frame prepared first, so ACK knows if it is the last
+	bool is_frame = PrepareFrame_(ssp);
+	
+	if(ssp->tx.ack.id == ID_NONE){
+		if(is_frame){
+			cold->bus.final_sent = true;
+			SetupTransmitterForFrame_(ssp);
+			return;
+		}
+		ssp->tx.ack.id = ID_KEEPALIVE;
+	}
+	
+	// No block for ACK - it waits for the next turn behind the frame
+	cold->bus.frame_ready = is_frame;
+	if(not CreateAck_(ssp, ssp->tx.ack.id)){
+		cold->bus.frame_ready = false;
+		if(is_frame){
+			cold->bus.final_sent = true;
+			SetupTransmitterForFrame_(ssp);
+		}
+		return;
+	}
+	SetupTransmitterForAck_(ssp);
+	if(not cold->bus.frame_ready) { cold->bus.final_sent = true; }
+}
+
+static inline bool 
+HandshakeTransmit_(ssp_str* ssp)
+{
+	ssp_cold_str* cold = Cold_(ssp);
+	
+	if(cold->handshake.reply){
+		if(CreateHello_(ssp)){
+			cold->handshake.reply = false;
+			SetupTransmitterForAck_(ssp);
+		}
+		return false;
+	}
+	
+	if(cold->handshake.done) { return true; }
+	if(cold->handshake.timeout) { return false; }
+	
+	// Nothing heard - peer without handshake
+	if(not cold->handshake.known and (cold->handshake.retries == HANDSHAKE_RETRIES)){
+		HandshakeApply_(ssp, false);
+		return true;
+	}
+	
+	if(not CreateHello_(ssp)) { return false; }
+	cold->handshake.retries++;
+	cold->handshake.timeout = TX_TIMEOUT;
+	SetupTransmitterForAck_(ssp);
+	return false;
+}
+
+static inline void 
+HandshakeReceived_(ssp_str* ssp)
+{
+	ssp_cold_str* cold = Cold_(ssp);
+	const uint8_t* hello = Block_(ssp, ssp->rx.buffer);
+	
+	// Any version keeps version 1 fields
+	if((hello[0] == 0)
+	or(hello[3] < ACK_SIZE_MAX)
+	or(hello[5] > FEC_SIZE_MAX)) { return; }
+	
+	cold->handshake.known = true;
+	cold->handshake.peer_caps = hello[2];
+	ssp->peer_buffer_size = hello[3];
+	cold->handshake.peer_window = hello[4];
+	cold->handshake.peer_fec_size = hello[5];
+	
+	// Peer restarted, or it has our settings
+	if(not (hello[1] & HELLO_SEEN)) { cold->handshake.done = false; }
+	else if(not cold->handshake.done) { HandshakeApply_(ssp, true); }
+	
+	if(not (hello[1] & HELLO_DONE)) { cold->handshake.reply = true; }
+}
+
+static inline void 
+HandshakeApply_(ssp_str* ssp, bool with_peer)
+{
+	ssp_cold_str* cold = Cold_(ssp);
+	
+	// Legacy peer shares nothing, not even control byte
+	uint8_t shared = with_peer? (cold->handshake.caps & cold->handshake.peer_caps) : 0;
+	uint8_t control = with_peer? ((cold->handshake.caps | cold->handshake.peer_caps) & CAP_CONTROL) : 0;
+	
+	ssp->framing = (shared & CAP_COBS)? SSP_FRAMING_COBS : SSP_FRAMING_ESCAPE;
+	
+	if(shared & CAP_CRC32C) { ssp->check_type = SSP_CHECK_CRC32C; }
+	else if(shared & CAP_CRC16) { ssp->check_type = SSP_CHECK_CRC16; }
+	else { ssp->check_type = SSP_CHECK_CRC8; }
+	ssp->check_size = check_size_table[ssp->check_type];
+	
+	ssp->fec_size = with_peer? MIN(ssp->hub->fec_size, cold->handshake.peer_fec_size) : 0;
+	
+	ssp->compression = (shared & CAP_COMPRESSION);
+	ssp->flow_control = (shared & CAP_FLOW_CONTROL);
+	ssp->control_size = (ssp->compression or ssp->flow_control or control)? CONTROL_SIZE : 0;
+	
+	// So no records and channel 0 only, records waiting are dropped
+	if(not with_peer) { 
+		ssp->peer_buffer_size = BUFFER_TOTAL_SIZE; 
+		AtomicStoreRelaxed(&ssp->aggregation.enabled, false);
+		ssp->aggregation.size = 0;
+		ssp->aggregation.encoded_size = 0;
+		ssp->aggregation.flush = false;
+		GiveBlock_(ssp, &ssp->aggregation.data);
+	}
+	AtomicStore(&ssp->link.credit, ssp->flow_control? cold->handshake.peer_window : CREDIT_MAX);
+	
+	cold->handshake.done = true;
+}
+
+static inline bool 
+CreateHello_(ssp_str* ssp)
+{
+	ssp_cold_str* cold = Cold_(ssp);
+	
+	if(not TakeBlock_(ssp, &ssp->tx.ack.data)) { return false; }
+	
+	uint8_t* data = Block_(ssp, ssp->tx.ack.data);
+	uint8_t size = 0;
+	
+	uint8_t flags = 0;
+	if(cold->handshake.known) { flags |= HELLO_SEEN; }
+	if(cold->handshake.done) { flags |= HELLO_DONE; }
+	
+	const uint8_t hello[HELLO_SIZE] = {
+		SSP_VERSION, flags, cold->handshake.caps, BUFFER_TOTAL_SIZE,
+		(cold->handshake.caps & CAP_FLOW_CONTROL)? GetCredit_(ssp) : 0,
+		ssp->hub->fec_size,
+	};
+	
+	#define AddByte(x) {data[size] = x; size++;}
+	
+	// Legacy escaping, whatever link settings are
+	for(uint8_t i = 0; i < HELLO_SIZE; i++){
+		if((hello[i] == COLLISION_SYMBOL)
+		or (hello[i] == COLLISION_MARKER))
+		{
+			AddByte(COLLISION_MARKER);
+			AddByte((hello[i] == COLLISION_MARKER)? COLLISION_FALSE : COLLISION_TRUE);
+		}
+		else { AddByte(hello[i]); }
+	}
+	
+	AddByte(size);
+	AddByte(ID_HELLO);
+	AddByte(HelloCheck_(ssp, data, size));
+	AddByte(END_MARKER);
+	
+	ssp->tx.ack.size = size;
+	
+	#undef AddByte
+	return true;
+}
+
+static inline bool 
+IsHello_(ssp_str* ssp, uint8_t size)
+{
+	const uint8_t* data = Block_(ssp, ssp->rx.buffer);
+	
+	return (size >= TRAILER_SIZE)
+		and(data[size - 2] == ID_HELLO)
+		and(data[size - 3] == size - TRAILER_SIZE)
+		and(data[size - 1] == HelloCheck_(ssp, data, size - CRC8_SIZE));
+}
 
+static inline uint8_t 
+HelloCheck_(ssp_str* ssp, const uint8_t* data, uint8_t size)
+{
+	uint8_t crc = HANDSHAKE_SEED;
+	for(uint8_t i = 0; i < size; i++){ crc = ssp->hub->CRC8_Function(data[i], crc); }
+	
 	// CRC8 collision handling
-	if(ssp->tx.ack.crc8 == END_MARKER) {
-		ssp->tx.ack.crc8 = COLLISION_MARKER;
+	return (crc == END_MARKER)? COLLISION_MARKER : crc;
+}
+
+static inline void 
+SessionHeard_(ssp_str* ssp)
+{
+	// Nothing to track without timeout
+	if(ssp->hub->dead_timeout == 0) { return; }
+	ssp_cold_str* cold = Cold_(ssp);
+	
+	// Back from silence - pending frame repeated at once
+	if(cold->session.silence >= ssp->hub->dead_timeout) { 
+		AtomicStore(&ssp->link.repeats, (uint8_t)(ssp->link.repeats + 1));
 	}
+	cold->session.alive = true;
+	cold->session.silence = 0;
+}
 
-	ssp->tx.ack.end = END_MARKER;
+static inline bool 
+CreateAck_(ssp_str* ssp, uint8_t id_to_ack)
+{
+	if(not TakeBlock_(ssp, &ssp->tx.ack.data)) { return false; }
+	
+	// ACK followed by frame in the same bus turn keeps the token
+	bool is_final = not (ssp->enabled.bus and Cold_(ssp)->bus.frame_ready);
+	
+	ssp_encoder_str enc;
+	EncoderInit_(ssp, &enc, Block_(ssp, ssp->tx.ack.data), is_final);
+	
+	// Credit as ACK payload
+	uint8_t control = 0;
+	if(ssp->flow_control){
+		uint8_t credit = AtomicLoad(&ssp->link.window);
+		AtomicStore(&ssp->link.advertised, credit);
+		EncodeByte_(ssp, &enc, credit);
+		control = CONTROL_CREDIT;
+	}
+	
+	if(ssp->control_size) { EncodeByte_(ssp, &enc, control); }
+	EncodeByte_(ssp, &enc, HEADER_SIZE);
+	EncodeByte_(ssp, &enc, id_to_ack);
+	EncodeCheck_(ssp, &enc);
+	
+	ssp->tx.ack.id = id_to_ack;
+	ssp->tx.ack.size = enc.size;
+	return true;
 }
 
 static inline bool
 CreateFrame_(ssp_str* ssp)
 {
-	#define AddByteToParcel(x) {ssp->tx.frame.data[data_size] = x; data_size++;}
+	return CreateFrameAbove_(ssp, PRIORITY_ANY);
+}
+
+static inline bool
+CreateFrameAbove_(ssp_str* ssp, uint16_t priority_end)
+{
+	// Only channels of priority below priority_end
+	uint8_t input[PAYLOAD_SIZE_MAX];
+	const uint8_t* payload = input;
+	uint8_t payload_size = 0;
+	uint8_t control = 0;
+	uint8_t priority = 0;
+	
+	// Nothing taken from input, if peer has no room
+	const uint8_t size_max = GetSendSizeMax_(ssp);
+	if(size_max == 0) { return false; }
+	
+	// Records are channel 0 input, sent at its priority
+	uint8_t channel = ScheduleChannel_(ssp, input, priority_end, size_max);
+	if(channel == CHANNEL_RECORDS){
+		payload = Block_(ssp, ssp->aggregation.data);
+		payload_size = ssp->aggregation.size;
+		control = CONTROL_AGGREGATED;
+		priority = ssp->hub->channel[0].priority;
+		
+		ssp->aggregation.size = 0;
+		ssp->aggregation.encoded_size = 0;
+		ssp->aggregation.flush = false;
+	}
+	else if(channel != CHANNEL_NONE) {
+		payload_size = CollectInput_(ssp, channel, input, size_max);
+		control = channel << CONTROL_CHANNEL_SHIFT;
+		priority = ssp->hub->channel[channel].priority;
+	}
 	
 	// Leave if no input
-	uint8_t value;
-	if(not ssp->INPUT_GetByte_(&value)) { return false; };
-	uint8_t data_size = 0;
+	if(payload_size == 0) { return false; }
 	
-	ResetCRC8(ssp);
-	do {
-		// On marker or collision occurance - encode
-		if( (value == COLLISION_SYMBOL)
-		or	(value == COLLISION_MARKER))
+	uint8_t packed[PAYLOAD_SIZE_MAX];
+	if(ssp->compression){
+		uint8_t packed_size = Compress_(payload, payload_size, packed, payload_size - 1);
+		
+		// Send compressed only if it is shorter on the wire
+		if(packed_size
+		and(GetEncodedSize_(ssp, packed, packed_size) < GetEncodedSize_(ssp, payload, payload_size)))
 		{
-			PushCRC8(ssp, COLLISION_MARKER);
-			AddByteToParcel(COLLISION_MARKER);
-			value = (value == COLLISION_MARKER)? COLLISION_FALSE : COLLISION_TRUE;
-			PushCRC8(ssp, value);
-			AddByteToParcel(value);
+			payload = packed;
+			payload_size = packed_size;
+			control |= CONTROL_COMPRESSED;
 		}
-		else { 
-			PushCRC8(ssp, value);
-			AddByteToParcel(value); 
+	}
+	
+	EncodeFrame_(ssp, payload, payload_size, control, GenerateNewID_(ssp->tx.frame.id));
+	ssp->tx.frame.priority = priority;
+	
+	// Records are in the frame now
+	if(control & CONTROL_AGGREGATED) { GiveBlock_(ssp, &ssp->aggregation.data); }
+	return true;
+}
+
+static inline bool
+IsAggregationReady_(ssp_str* ssp)
+{
+	return (ssp->aggregation.size > 0)
+		and((ssp->aggregation.flush)
+		or	(ssp->aggregation.timeout == 0)
+		or	(ssp->aggregation.size >= (ssp->hub->aggregation_fill? 
+										ssp->hub->aggregation_fill : GetInputSizeMax_(ssp))));
+}
+
+static inline uint8_t
+CollectInput_(ssp_str* ssp, uint8_t channel, uint8_t* data, uint8_t size_max)
+{
+	uint8_t size = 0;
+	uint8_t encoded_size = 0;
+	
+	// First byte already taken by scheduler
+	do {
+		encoded_size++;
+		if((data[size] == COLLISION_SYMBOL) or (data[size] == COLLISION_MARKER)) { encoded_size++; }
+		size++;
+		
+		// Escaped: atleast 2 bytes left free
+		if((ssp->framing == SSP_FRAMING_ESCAPE)
+		and(encoded_size > size_max - COLLISION_SIZE)) { break; }
+		
+	}while((size < size_max) and ssp->hub->channel[channel].INPUT_GetByte_(&data[size]));
+	
+	return size;
+}
+
+static inline uint8_t
+ScheduleChannel_(ssp_str* ssp, uint8_t* first, uint16_t priority_end, uint8_t size_max)
+{
+	// Strict between priority levels. Round robin inside level,
+	// starting from channel which weight is not spent yet.
+	// Ready records fitting size_max go ahead of channel 0 bytes.
+	// No control byte, no channel ID - channel 0 only
+	const ssp_hub_str* hub = ssp->hub;
+	const uint8_t count = ssp->control_size? hub->channels_count : 1;
+	for(uint16_t priority = 0; (priority <= hub->priority_max) and (priority < priority_end); priority++){
+		for(uint8_t n = 0; n < count; n++){
+			
+			uint8_t index = (ssp->schedule.next + n) % count;
+			const ssp_channel_str* channel = &hub->channel[index];
+			
+			if(channel->priority != priority) { continue; }
+			
+			bool is_records = (index == 0) and IsAggregationReady_(ssp)
+				and (ssp->aggregation.size <= size_max);
+			if(not is_records){
+				if(channel->INPUT_GetByte_ == NULL) { continue; }
+				if(not channel->INPUT_GetByte_(first)) { continue; }
+			}
+			
+			if(index != ssp->schedule.next) { ssp->schedule.credit = 0; }
+			ssp->schedule.credit++;
+			
+			if(ssp->schedule.credit >= MAX(channel->weight, 1)) {
+				ssp->schedule.next = (index + 1) % count;
+				ssp->schedule.credit = 0;
+			}
+			else { ssp->schedule.next = index; }
+			
+			return is_records? CHANNEL_RECORDS : index;
+		}
+	}
+	
+	return CHANNEL_NONE;
+}
+
+static inline bool
+InitChannels_(ssp_hub_str* hub, const ssp_init_str* config)
+{
+	// Single channel
+	if(config->channels_count == 0){
+		if(not config->OUTPUT_PutByte_) { return false; }
+		if(not config->INPUT_GetByte_ and not config->aggregation) { return false; }
+		
+		hub->channel[0].INPUT_GetByte_ = config->INPUT_GetByte_;
+		hub->channel[0].OUTPUT_PutByte_ = config->OUTPUT_PutByte_;
+		hub->channels_count = 1;
+		return true;
+	}
+	
+	// Input may be absent for receive only channel
+	for(uint8_t i = 0; i < config->channels_count; i++){
+		if(not config->channels[i].OUTPUT_PutByte_) { return false; }
+		
+		hub->channel[i] = config->channels[i];
+		hub->priority_max = MAX(hub->priority_max, config->channels[i].priority);
+	}
+	
+	hub->channels_count = config->channels_count;
+	return true;
+}
+
+static inline void
+EncodeFrame_(ssp_str* ssp, const uint8_t* data, uint8_t size, uint8_t control, uint8_t id)
+{
+	ssp_encoder_str enc;
+	EncoderInit_(ssp, &enc, Block_(ssp, ssp->tx.frame.data), true);
+	
+	for(uint8_t i = 0; i < size; i++){ EncodeByte_(ssp, &enc, data[i]); }
+	
+	// Size counts payload covered by check: escaped in legacy frame, raw otherwise
+	uint8_t header_size = IsLegacyFrame(ssp)? enc.size : size;
+	
+	if(ssp->control_size) { EncodeByte_(ssp, &enc, control); }
+	EncodeByte_(ssp, &enc, header_size);
+	
+	ssp->tx.frame.id = id;
+	EncodeByte_(ssp, &enc, id);
+	
+	EncodeCheck_(ssp, &enc);
+	ssp->tx.frame.size = enc.size;
+}
+
+static inline uint8_t
+GetEncodedSize_(ssp_str* ssp, const uint8_t* data, uint8_t size)
+{
+	return (ssp->framing == SSP_FRAMING_ESCAPE)? GetEscapedSize_(data, size) : size;
+}
+
+static inline uint8_t
+GetEscapedSize_(const uint8_t* data, uint8_t size)
+{
+	uint8_t encoded_size = size;
+	for(uint8_t i = 0; i < size; i++){
+		if((data[i] == COLLISION_SYMBOL) or (data[i] == COLLISION_MARKER)) { encoded_size++; }
+	}
+	return encoded_size;
+}
+
+static inline uint8_t
+Compress_(const uint8_t* data, uint8_t size, uint8_t* output, uint8_t size_max)
+{
+	uint8_t output_size = 0;
+	uint8_t flags_index = 0;
+	uint8_t item = LZ_GROUP_SIZE;
+	uint8_t i = 0;
+	
+	while(i < size){
+		
+		// New group flags byte
+		if(item == LZ_GROUP_SIZE){
+			if(output_size >= size_max) { return 0; }
+			flags_index = output_size;
+			output[output_size++] = 0;
+			item = 0;
+		}
+		
+		// Greedy longest match search over already passed bytes
+		uint8_t match_offset = 0;
+		uint8_t match_size = 0;
+		for(uint8_t j = 0; j < i; j++){
+			uint8_t k = 0;
+			while((i + k < size) and (data[j + k] == data[i + k])) { k++; }
+			if(k > match_size) { match_size = k; match_offset = i - j; }
+		}
+		
+		if(match_size >= LZ_MATCH_SIZE_MIN){
+			if(output_size + LZ_MATCH_TOKEN_SIZE > size_max) { return 0; }
+			output[flags_index] |= 1 << item;
+			output[output_size++] = match_offset;
+			output[output_size++] = match_size - LZ_MATCH_SIZE_MIN;
+			i += match_size;
+		}
+		else {
+			if(output_size >= size_max) { return 0; }
+			output[output_size++] = data[i++];
+		}
+		
+		item++;
+	}
+	
+	return output_size;
+}
+
+static inline uint8_t
+Decompress_(const uint8_t* data, uint8_t size, uint8_t* output, uint8_t size_max)
+{
+	uint8_t output_size = 0;
+	uint8_t flags = 0;
+	uint8_t item = LZ_GROUP_SIZE;
+	uint8_t i = 0;
+	
+	while(i < size){
+		
+		if(item == LZ_GROUP_SIZE){
+			flags = data[i++];
+			item = 0;
+			continue;
 		}
 		
-		// Atleast 2 bytes left free
-		if(data_size > PAYLOAD_SIZE_MAX - 1) { break; }
+		if(flags & (1 << item)){
+			if(i + LZ_MATCH_TOKEN_SIZE > size) { return 0; }
+			uint8_t offset = data[i++];
+			uint16_t match_size = data[i++] + LZ_MATCH_SIZE_MIN;
+			
+			if((offset == 0) or (offset > output_size)) { return 0; }
+			if(output_size + match_size > size_max) { return 0; }
 			
-	}while(ssp->INPUT_GetByte_(&value));
+			// Byte by byte, match may overlap itself
+			for(uint16_t k = 0; k < match_size; k++, output_size++){
+				output[output_size] = output[output_size - offset];
+			}
+		}
+		else {
+			if(output_size >= size_max) { return 0; }
+			output[output_size++] = data[i++];
+		}
+		
+		item++;
+	}
+	
+	return output_size;
+}
+
+static inline void 
+EncoderInit_(ssp_str* ssp, ssp_encoder_str* enc, uint8_t* data, bool is_final)
+{
+	enc->data = data;
+	enc->size = 0;
+	enc->code_index = 0;
+	memset(enc->parity, 0, sizeof(enc->parity));
 	
-	PushCRC8(ssp, data_size);
-	AddByteToParcel(data_size);
+	ResetCheck(ssp);
 	
-	ssp->tx.frame.id = GenerateNewID_(ssp->tx.frame.id);
-	PushCRC8(ssp, ssp->tx.frame.id);
-	AddByteToParcel(ssp->tx.frame.id);
+	// Raw address, checked but not encoded
+	if(ssp->enabled.bus){
+		const ssp_cold_str* cold = Cold_(ssp);
+		enc->data[0] = cold->bus.peer;
+		enc->data[1] = cold->bus.address | (is_final? BUS_TOKEN : 0);
+		UpdateCheck_(ssp, enc->data, BUS_PREFIX_SIZE);
+		enc->size = BUS_PREFIX_SIZE;
+		enc->code_index = BUS_PREFIX_SIZE;
+	}
 	
-	ssp->tx.frame.data[data_size] = GetCRC8(ssp); 
+	// Reserve first code byte
+	if(ssp->framing == SSP_FRAMING_COBS) { enc->size++; }
+}
 
-	// CRC8 collision handling
-	if(ssp->tx.frame.data[data_size] == END_MARKER) {
-		ssp->tx.frame.data[data_size] = COLLISION_MARKER;
+static inline void 
+EncodeByte_(ssp_str* ssp, ssp_encoder_str* enc, uint8_t value)
+{
+	// Legacy frame checks escaped bytes instead
+	if(not IsLegacyFrame(ssp)) { PushCheck(ssp, value); }
+	
+	FecPush_(ssp, enc->parity, value);
+	PutEncoded_(ssp, enc, value);
+}
+
+static inline void 
+PutEncoded_(ssp_str* ssp, ssp_encoder_str* enc, uint8_t value)
+{
+	#define AddByte(x) {enc->data[enc->size] = x; enc->size++;}
+	#define CloseCodeBlock() {enc->data[enc->code_index] = enc->size - enc->code_index; \
+							  enc->code_index = enc->size; enc->size++;}
+	#define PushLegacyCheck(x) {if(IsLegacyFrame(ssp)) { PushCheck(ssp, x); }}
+	
+	if(ssp->framing == SSP_FRAMING_COBS) {
+		if(value == END_MARKER) { CloseCodeBlock(); }
+		else {
+			AddByte(value);
+			if(enc->size - enc->code_index == COBS_CODE_MAX) { CloseCodeBlock(); }
+		}
+	}
+	// On marker or collision occurance - encode
+	else if((value == COLLISION_SYMBOL)
+		or	(value == COLLISION_MARKER))
+	{
+		PushLegacyCheck(COLLISION_MARKER);
+		AddByte(COLLISION_MARKER);
+		value = (value == COLLISION_MARKER)? COLLISION_FALSE : COLLISION_TRUE;
+		PushLegacyCheck(value);
+		AddByte(value);
+	}
+	else { 
+		PushLegacyCheck(value);
+		AddByte(value); 
+	}
+	
+	#undef AddByte
+	#undef CloseCodeBlock
+	#undef PushLegacyCheck
+}
+
+static inline void 
+EncodeCheck_(ssp_str* ssp, ssp_encoder_str* enc)
+{
+	uint32_t check = GetCheck(ssp);
+	
+	if(IsLegacyFrame(ssp)) {
+		// CRC8 collision handling
+		if(check == END_MARKER) { check = COLLISION_MARKER; }
+		enc->data[enc->size] = (uint8_t)check;
+		enc->size++;
+	}
+	else {
+		// Check is not part of itself, encoding still needed
+		for(uint8_t i = 0; i < ssp->check_size; i++){
+			FecPush_(ssp, enc->parity, (uint8_t)(check >> (8 * i)));
+			PutEncoded_(ssp, enc, (uint8_t)(check >> (8 * i)));
+		}
+		
+		for(uint8_t i = 0; i < ssp->fec_size; i++){
+			PutEncoded_(ssp, enc, enc->parity[i]);
+		}
+	}
+	
+	if(ssp->framing == SSP_FRAMING_COBS) {
+		enc->data[enc->code_index] = enc->size - enc->code_index;
 	}
+	
+	enc->data[enc->size] = END_MARKER;
+	enc->size++;
+}
 
-	data_size++;
-	ssp->tx.frame.data[data_size] = END_MARKER; 
-	data_size++;
-	ssp->tx.frame.size = data_size;
+static inline bool 
+DecodeEscaped_(uint8_t* data, uint8_t* size)
+{
+	uint8_t decoded = 0;
+	
+	for(uint8_t i = 0; i < *size; i++, decoded++){
+		if(data[i] == COLLISION_MARKER){
+			i++;
+			if(i == *size) { return false; }
+			else if(data[i] == COLLISION_FALSE) { data[decoded] = COLLISION_MARKER; }
+			else if(data[i] == COLLISION_TRUE) { data[decoded] = COLLISION_SYMBOL; }
+			else { return false; }
+		}
+		else { data[decoded] = data[i]; }
+	}
+	
+	*size = decoded;
+	return true;
+}
 
+static inline bool 
+DecodeCOBS_(uint8_t* data, uint8_t* size)
+{
+	uint8_t decoded = 0;
+	uint8_t i = 0;
+	
+	while(i < *size){
+		uint8_t code = data[i];
+		if((code == 0) or (code > COBS_CODE_MAX)) { return false; }
+		if(code > *size - i) { return false; }
+		i++;
+		
+		for(uint8_t j = 1; j < code; j++, i++, decoded++){
+			data[decoded] = data[i];
+		}
+		
+		// Full block has no encoded END after it, last block neither
+		if((code < COBS_CODE_MAX) and (i < *size)){
+			data[decoded] = END_MARKER;
+			decoded++;
+		}
+	}
+	
+	*size = decoded;
 	return true;
+}
+
+static inline uint8_t 
+GetInputSizeMax_(ssp_str* ssp)
+{
+	// Frame must fit peer buffer as well
+	uint8_t size = MIN(BUFFER_TOTAL_SIZE, ssp->peer_buffer_size) 
+				 - (HEADER_SIZE - CRC8_SIZE) - ssp->control_size;
+	
+	if(ssp->framing == SSP_FRAMING_COBS) { 
+		return size - ssp->check_size - ssp->fec_size - COBS_OVERHEAD(BUFFER_TOTAL_SIZE); 
+	}
+	else if(IsLegacyFrame(ssp)) { return size - CRC8_SIZE; }
+	// Escaped check and parity bytes
+	else { return size - (ssp->check_size + ssp->fec_size) * COLLISION_SIZE; }
+}
+
+static inline bool
+IsQueueFitting_(const ssp_str* ssp, const uint8_t* data, uint8_t size)
+{
+	// Any format handshake may agree on - hub check and FEC at most,
+	// control byte as records need it. Escaping is the worst framing.
+	const ssp_hub_str* hub = ssp->hub;
+	uint8_t size_max = BUFFER_TOTAL_SIZE - (HEADER_SIZE - CRC8_SIZE) - CONTROL_SIZE;
+	uint8_t tail_size = check_size_table[hub->check_type] + hub->fec_size;
+	
+	if((hub->framing == SSP_FRAMING_COBS) and not ssp->enabled.handshake){
+		return RECORD_HEADER_SIZE + size <= size_max - tail_size - COBS_OVERHEAD(BUFFER_TOTAL_SIZE);
+	}
+	return GetEscapedSize_(&size, RECORD_HEADER_SIZE) + GetEscapedSize_(data, size) 
+		<= size_max - tail_size * COLLISION_SIZE;
+}
+
+static inline uint8_t 
+GetSendSizeMax_(ssp_str* ssp)
+{
+	if(ssp->flow_control) { return MIN(GetInputSizeMax_(ssp), AtomicLoad(&ssp->link.credit)); }
+	else { return GetInputSizeMax_(ssp); }
+}
+
+static inline uint32_t 
+CheckSeed_(const ssp_str* ssp)
+{
+	switch(ssp->check_type){
+		case SSP_CHECK_CRC16: return CRC16_SEED;
+		case SSP_CHECK_CRC32C: return CRC32C_SEED;
+		default: return 0;
+	}
+}
+
+static inline uint32_t 
+CheckUpdate_(const ssp_str* ssp, uint8_t value, uint32_t check)
+{
+	switch(ssp->check_type){
+		case SSP_CHECK_CRC16:
+			return (uint16_t)(check << 8) ^ crc16_table[((check >> 8) ^ value) & 0xFF];
+			
+		case SSP_CHECK_CRC32C:
+			#if defined(__SSE4_2__)
+			return _mm_crc32_u8(check, value);
+			#elif defined(__ARM_FEATURE_CRC32)
+			return __crc32cb(check, value);
+			#else
+			return (check >> 8) ^ crc32c_table[(check ^ value) & 0xFF];
+			#endif
+			
+		default:
+			return ssp->hub->CRC8_Function(value, (uint8_t)check);
+	}
+}
+
+static inline uint32_t 
+CheckFinal_(const ssp_str* ssp, uint32_t check)
+{
+	if(ssp->check_type == SSP_CHECK_CRC32C) { return ~check; }
+	else { return check; }
+}
+
+static inline uint32_t 
+CalculateCheck_(ssp_str* ssp, const uint8_t* data, uint8_t size)
+{
+	ResetCheck(ssp);
+	UpdateCheck_(ssp, data, size);
+	return GetCheck(ssp);
+}
+
+static inline void 
+UpdateCheck_(ssp_str* ssp, const uint8_t* data, uint8_t size)
+{
+	ssp->check = CheckBlock_(ssp, data, size, ssp->check);
+}
+
+static inline uint32_t 
+CheckBlock_(const ssp_str* ssp, const uint8_t* data, uint8_t size, uint32_t check)
+{
+	#if CRC32C_DISPATCH
+	if((ssp->check_type == SSP_CHECK_CRC32C) and __builtin_cpu_supports("sse4.2")){
+		return CheckBlockSse42_(data, size, check);
+	}
+	#endif
+	
+	#if defined(__SSE4_2__) or defined(__ARM_FEATURE_CRC32)
+	// CRC32C hardware instructions take 8 bytes at once
+	if(ssp->check_type == SSP_CHECK_CRC32C){
+		uint64_t block;
+		for(; size >= sizeof(block); size -= sizeof(block), data += sizeof(block)){
+			memcpy(&block, data, sizeof(block));
+			#if defined(__SSE4_2__) and defined(__x86_64__)
+			check = (uint32_t)_mm_crc32_u64(check, block);
+			#elif defined(__SSE4_2__)
+			check = _mm_crc32_u32(check, (uint32_t)block);
+			check = _mm_crc32_u32(check, (uint32_t)(block >> 32));
+			#else
+			check = __crc32cd(check, block);
+			#endif
+		}
+	}
+	#endif
+	
+	for(uint8_t i = 0; i < size; i++){ check = CheckUpdate_(ssp, data[i], check); }
+	return check;
+}
+
+#if CRC32C_DISPATCH
+__attribute__((target("sse4.2"))) static uint32_t 
+CheckBlockSse42_(const uint8_t* data, uint8_t size, uint32_t check)
+{
+	uint64_t block;
+	for(; size >= sizeof(block); size -= sizeof(block), data += sizeof(block)){
+		memcpy(&block, data, sizeof(block));
+		#if defined(__x86_64__)
+		check = (uint32_t)_mm_crc32_u64(check, block);
+		#else
+		check = _mm_crc32_u32(check, (uint32_t)block);
+		check = _mm_crc32_u32(check, (uint32_t)(block >> 32));
+		#endif
+	}
+	
+	for(uint8_t i = 0; i < size; i++){ check = _mm_crc32_u8(check, data[i]); }
+	return check;
+}
+#endif
+
+static inline void 
+FecPush_(const ssp_str* ssp, uint8_t* parity, uint8_t value)
+{
+	if(ssp->fec_size == 0) { return; }
+	
+	// Systematic encoding, division by generator in LFSR form
+	const uint8_t* generator = fec_generator_table[ssp->fec_size];
+	uint8_t feedback = value ^ parity[0];
+	for(uint8_t i = 0; i < ssp->fec_size - 1; i++){
+		parity[i] = parity[i + 1] ^ GF_Mul(generator[i + 1], feedback);
+	}
+	parity[ssp->fec_size - 1] = GF_Mul(generator[ssp->fec_size], feedback);
+}
+
+static inline bool 
+FecCorrect_(const ssp_str* ssp, uint8_t* data, uint8_t size)
+{
+	const uint8_t nsym = ssp->fec_size;
+	uint8_t syndrome[FEC_SIZE_MAX];
+	bool is_damaged = false;
+	
+	// Syndromes - received polynomial at a^j
+	for(uint8_t j = 0; j < nsym; j++){
+		uint8_t value = 0;
+		for(uint8_t i = 0; i < size; i++){ value = GF_Mul(value, gf_exp[j]) ^ data[i]; }
+		syndrome[j] = value;
+		if(value) { is_damaged = true; }
+	}
+	
+	if(not is_damaged) { return true; }
+	
+	// Berlekamp-Massey error locator. Lowest power first.
+	uint8_t locator[FEC_SIZE_MAX + 1] = { 1 };
+	uint8_t previous[FEC_SIZE_MAX + 1] = { 1 };
+	uint8_t temp[FEC_SIZE_MAX + 1];
+	uint8_t errors = 0;
+	uint8_t shift = 1;
+	uint8_t last_discrepancy = 1;
+	
+	for(uint8_t k = 0; k < nsym; k++){
+		uint8_t discrepancy = syndrome[k];
+		for(uint8_t i = 1; i <= errors; i++){
+			discrepancy ^= GF_Mul(locator[i], syndrome[k - i]);
+		}
+		
+		if(discrepancy == 0) { shift++; continue; }
+		
+		uint8_t coef = GF_Div(discrepancy, last_discrepancy);
+		memcpy(temp, locator, sizeof(temp));
+		for(uint8_t i = shift; i <= nsym; i++){
+			locator[i] ^= GF_Mul(coef, previous[i - shift]);
+		}
+		
+		if(2 * errors <= k){
+			errors = k + 1 - errors;
+			memcpy(previous, temp, sizeof(previous));
+			last_discrepancy = discrepancy;
+			shift = 1;
+		}
+		else { shift++; }
+	}
+	
+	if(2 * errors > nsym) { return false; }
+	
+	// Error evaluator - syndromes * locator mod x^nsym
+	uint8_t evaluator[FEC_SIZE_MAX] = { 0 };
+	for(uint8_t i = 0; i < nsym; i++){
+		for(uint8_t j = 0; j <= i; j++){
+			evaluator[i] ^= GF_Mul(syndrome[j], locator[i - j]);
+		}
+	}
+	
+	// Chien search for locator roots, Forney for magnitudes
+	uint8_t found = 0;
+	for(uint8_t i = 0; i < size; i++){
+		uint8_t power = size - 1 - i;
+		uint8_t x_inv = gf_exp[(255 - power) % 255];
+		
+		uint8_t value = 0;
+		for(uint8_t t = errors + 1; t > 0; t--){ value = GF_Mul(value, x_inv) ^ locator[t - 1]; }
+		if(value) { continue; }
+		
+		uint8_t omega = 0;
+		for(uint8_t t = nsym; t > 0; t--){ omega = GF_Mul(omega, x_inv) ^ evaluator[t - 1]; }
+		
+		// Formal derivative keeps odd powers only
+		uint8_t derivative = 0;
+		uint8_t x_inv_square = GF_Mul(x_inv, x_inv);
+		for(uint8_t t = (errors - 1) | 1; t > 0 and t <= errors; t -= 2){
+			derivative = GF_Mul(derivative, x_inv_square) ^ locator[t];
+		}
+		if(derivative == 0) { return false; }
+		
+		data[i] ^= GF_Mul(gf_exp[power], GF_Div(omega, derivative));
+		found++;
+	}
 	
-	#undef AddByteToParcel
+	return (found == errors);
 }
 
 static inline void 
 SetupTransmitterForAck_(ssp_str* ssp)
 {
-	ssp->tx.data = (uint8_t*)&ssp->tx.ack;
-	ssp->tx.size = HEADER_SIZE;
+	ssp->tx.data = ssp->tx.ack.data;
+	ssp->tx.size = ssp->tx.ack.size;
 	ssp->tx.counter = 0;
 }
 
@@ -378,6 +2659,7 @@ ResetReceiver_(ssp_str* ssp)
 {
 	ssp->rx.index = 0;
 	ssp->rx.size = 0;
+	GiveBlock_(ssp, &ssp->rx.buffer);
 }
 
 static inline uint8_t 
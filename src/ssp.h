@@ -34,55 +34,415 @@ typedef struct{
 #define COLLISION_FALSE			(0x00)
 #define COLLISION_SIZE			(2)
 
+#define COBS_CODE_MAX			(0xFE)
+#define COBS_BLOCK_SIZE			(COBS_CODE_MAX - 1)
+#define COBS_OVERHEAD(size)		(((size) / COBS_BLOCK_SIZE) + 1)
+
 #define ID_NONE					(0x00)
 #define ID_MIN					(0x01)
 #define ID_MAX					(0x80)
+#define ID_HELLO				(0xF0)
+#define ID_RESET				(0xF1)
+#define ID_KEEPALIVE			(0xF2)
 
 #define CRC8_SEED				(0xB1)
+#define CRC8_SIZE				(sizeof(uint8_t))
+#define CRC16_SEED				(0xFFFF)
+#define CRC32C_SEED				(0xFFFFFFFF)
+#define CHECK_SIZE_MAX			(sizeof(uint32_t))
+
+#define CONTROL_SIZE			(1)
+#define CONTROL_COMPRESSED		(0x01)
+#define CONTROL_AGGREGATED		(0x02)
+#define CONTROL_CREDIT			(0x04)
+
+#define CONTROL_CHANNEL_SHIFT	(4)
+#define CONTROL_CHANNEL_MASK	(0xF0)
+
+#define RECORD_HEADER_SIZE		(1)
+
+#define BUS_PREFIX_SIZE			(2)
+#define BUS_TOKEN				(0x80)
+#define BUS_ADDRESS_MAX			(0x7E)
+
+#define SSP_VERSION				(1)
+#define HANDSHAKE_SEED			(CRC8_SEED)
+#define HANDSHAKE_RETRIES		(3)
+#define HELLO_SIZE				(6)
+#define HELLO_SEEN				(0x01)
+#define HELLO_DONE				(0x02)
+
+#define CAP_COBS				(0x01)
+#define CAP_CRC16				(0x02)
+#define CAP_CRC32C				(0x04)
+#define CAP_COMPRESSION			(0x08)
+#define CAP_FLOW_CONTROL		(0x10)
+#define CAP_CONTROL				(0x20)
+
+#define CREDIT_SIZE				(1)
+#define CREDIT_MAX				(0xFF)
+
+// Link without embedded buffers and callbacks, for hubs holding
+// thousands of them. SPP_Init takes shared hub and pool.
+#ifndef SSP_COMPACT
+#define SSP_COMPACT				(0)
+#endif
+
+// Own buffers of optional features, 0 drops them from links without pool.
+// SPP_Init fails then for aggregation, flow control or block transmit
+// unless pool is given.
+#ifndef SSP_AGGREGATION
+#define SSP_AGGREGATION			(1)
+#endif
+#ifndef SSP_FLOW_CONTROL
+#define SSP_FLOW_CONTROL		(1)
+#endif
+#ifndef SSP_DOUBLE_BUFFER
+#define SSP_DOUBLE_BUFFER		(1)
+#endif
+#define SSP_OWN_FIFO			(SSP_FLOW_CONTROL && !SSP_COMPACT)
+
+#ifndef RX_FIFO_SIZE
+#if SSP_OWN_FIFO
+#define RX_FIFO_SIZE			(2 * BUFFER_TOTAL_SIZE)
+#else
+#define RX_FIFO_SIZE			(BUFFER_TOTAL_SIZE)
+#endif
+#endif
+#define RX_FIFO_ENTRY_HEADER	(2)
+
+#ifndef CHANNELS_MAX
+#define CHANNELS_MAX			(4)
+#endif
+#define CHANNEL_NONE			(0xFF)
+#define CHANNEL_RECORDS			(0xFE)
+#define PRIORITY_ANY			(0x100)
+
+#if CHANNELS_MAX > (CONTROL_CHANNEL_MASK >> CONTROL_CHANNEL_SHIFT) + 1
+#error "Channel ID must fit into control byte"
+#endif
+
+#define LZ_MATCH_SIZE_MIN		(3)
+#define LZ_MATCH_TOKEN_SIZE		(2)
+#define LZ_GROUP_SIZE			(8)
+
+#ifndef UART_BITS_PER_BYTE
+#define UART_BITS_PER_BYTE		(10)
+#endif
+#define MICROS_PER_SECOND		(1000000UL)
+#define PACING_BYTE_COST		((uint64_t)UART_BITS_PER_BYTE * MICROS_PER_SECOND)
+
+#define FEC_SIZE_MAX			(8)
+#define FEC_POLYNOMIAL			(0x11D)
 #define TX_TIMEOUT				(5000)
 
 #define BUFFER_TOTAL_SIZE		(64)
 #define OVERFLOW_MASK			(BUFFER_TOTAL_SIZE - 1)
 
+#if RX_FIFO_SIZE < BUFFER_TOTAL_SIZE
+#error "Receive FIFO must hold atleast one frame"
+#endif
+
+// Frame with bus prefix. Blocks are rounded up, so each one is aligned
+// as blocks array is and may hold link state as well.
+#define FRAME_BUFFER_SIZE		(BUS_PREFIX_SIZE + BUFFER_TOTAL_SIZE)
+#define POOL_BLOCK_ALIGN		(8)
+#define POOL_BLOCK_SIZE			((FRAME_BUFFER_SIZE + POOL_BLOCK_ALIGN - 1) / POOL_BLOCK_ALIGN * POOL_BLOCK_ALIGN)
+#define POOL_NONE				(0xFFFF)
+#define POOL_INDEX_MASK			(0xFFFF)
+#define POOL_TAG_STEP			(0x10000)
+
+// Queued message block - [NEXT L] [NEXT H] [SIZE] [DATA]
+#define QUEUE_SIZE_INDEX		(sizeof(uint16_t))
+#define QUEUE_HEADER_SIZE		(QUEUE_SIZE_INDEX + RECORD_HEADER_SIZE)
+#define QUEUE_MESSAGE_MAX		(PAYLOAD_SIZE_MAX - RECORD_HEADER_SIZE)
+#ifndef QUEUE_POOL_RESERVE
+#define QUEUE_POOL_RESERVE		(4)
+#endif
+
+#if !SSP_OWN_FIFO && (RX_FIFO_SIZE > POOL_BLOCK_SIZE)
+#error "FIFO without own buffer must fit into pool block"
+#endif
+
 #define END_BYTE_SIZE			(1)
 #define HEADER_SIZE				(sizeof(ssp_frame_header_str))
+#define TRAILER_SIZE			(HEADER_SIZE - END_BYTE_SIZE)
 #define PAYLOAD_SIZE_MAX		(BUFFER_TOTAL_SIZE - HEADER_SIZE)
 #define INPUT_DATA_SIZE_MAX		(PAYLOAD_SIZE_MAX / COLLISION_SIZE)
+#define COBS_INPUT_DATA_SIZE_MAX	(PAYLOAD_SIZE_MAX - COBS_OVERHEAD(BUFFER_TOTAL_SIZE))
+#define ACK_SIZE_MAX			(BUS_PREFIX_SIZE + HEADER_SIZE - CRC8_SIZE + CONTROL_SIZE + CREDIT_SIZE \
+								+ (CHECK_SIZE_MAX + FEC_SIZE_MAX) * COLLISION_SIZE \
+								+ COBS_OVERHEAD(BUFFER_TOTAL_SIZE))
+
+typedef enum {
+	SSP_FRAMING_ESCAPE,		// Collision marker escaping, up to 2x overhead
+	SSP_FRAMING_COBS,		// Consistent overhead byte stuffing, 1 byte per 253
+}ssp_framing_enum;
+
+typedef enum {
+	SSP_CHECK_CRC8,			// User CRC8 function, legacy
+	SSP_CHECK_CRC16,		// CRC16-CCITT (0x1021), table driven
+	SSP_CHECK_CRC32C,		// CRC32C (Castagnoli), SSE4.2/ARMv8 if available
+}ssp_check_enum;
+
+// Buffers are blocks - pool index, or offset of own one without pool
+typedef struct {
+	bool ack_received;
+	uint8_t id;
+	uint8_t size;
+	uint8_t priority;
+	uint16_t data;
+}ssp_frame_str;
 
 typedef struct {
 	
-	uint8_t crc8;
+	bool (*INPUT_GetByte_)(uint8_t* value_ptr);
+	bool (*OUTPUT_PutByte_)(uint8_t value);
+	
+	// 0 - highest. Lower level sent only if all higher have no input.
+	uint8_t priority;
+	// Frames in a row among channels of equal priority, 0 acts as 1
+	uint8_t weight;
+	
+}ssp_channel_str;
+
+// Callbacks and channels, one copy per hub of identical links
+typedef struct {
+	
 	uint8_t (*CRC8_Function)(uint8_t inbyte, uint8_t crc8);
 	
 	bool (*UART_GetByte_)(uint8_t* value_ptr);
 	bool (*UART_PutByte_)(uint8_t value);
+	bool (*UART_PutBlock_)(const uint8_t* data, uint8_t size);
+	const uint8_t* (*UART_GetBlock_)(uint8_t* size_ptr);
+	void (*UART_ReleaseBlock_)(const uint8_t* data);
 	
-	bool (*INPUT_GetByte_)(uint8_t* value_ptr);
-	bool (*OUTPUT_PutByte_)(uint8_t value);
+	bool (*OUTPUT_PutRecord_)(const uint8_t* data, uint8_t size);
+	uint32_t (*TIME_GetMicros_)(void);
+	
+	ssp_channel_str channel[CHANNELS_MAX];
+	uint8_t channels_count;
+	uint8_t priority_max;
+	
+	// Link settings, handshake links may agree on less
+	ssp_framing_enum framing;
+	ssp_check_enum check_type;
+	uint8_t fec_size;
+	
+	uint8_t aggregation_fill;
+	uint16_t aggregation_delay;
+	uint16_t keepalive;
+	uint16_t dead_timeout;
+	uint16_t bus_timeout;
+	
+	// Token bucket, microsecond adds baud_rate, capped at depth
+	uint32_t baud_rate;
+	uint64_t pacing_depth;
+	
+}ssp_hub_str;
+
+// Lock-free stack of free blocks, next holds link of each block.
+// Links are apart from blocks, as taker may read one being rewritten.
+// Blocks array aligned to POOL_BLOCK_ALIGN, SPP_PoolInit fails otherwise.
+typedef struct {
 	
+	uint8_t (*blocks)[POOL_BLOCK_SIZE];
+	uint16_t* next;
+	uint16_t count;
+	uint16_t available;
+	
+	// Tag in high half changes on every update against ABA
+	uint32_t head;
+	
+}ssp_pool_str;
+
+// State of handshake, session, bus and pacing, touched once per frame
+// or less. Pool block taken by SPP_Init, own one without pool.
+typedef struct {
+	
+	// Token bucket, byte costs PACING_BYTE_COST, rate and depth in hub
 	struct {
-		uint8_t last_received_id;
-		uint8_t buffer[BUFFER_TOTAL_SIZE];
+		uint64_t tokens;
+		uint32_t last_time;
+	}pacing;
+	
+	struct {
+		bool known : 1;
+		bool done : 1;
+		bool reply : 1;
+		uint8_t caps;
+		uint8_t retries;
+		uint16_t timeout;
+		
+		uint8_t peer_caps;
+		uint8_t peer_window;
+		uint8_t peer_fec_size;
+	}handshake;
+	
+	// Receive half - alive and silence, transmit half - the rest
+	struct {
+		bool alive;
+		bool established;
+		uint16_t silence;
+		uint16_t keepalive_timeout;
+	}session;
+	
+	struct {
+		bool master : 1;
+		bool token : 1;
+		bool token_received : 1;
+		bool frame_ready : 1;
+		bool final_sent : 1;
+		bool turn_over : 1;
+		uint8_t address;
+		uint8_t peer;
+		uint16_t timeout;
+		
+		// Prefix of frame being received
+		uint8_t prefix[BUS_PREFIX_SIZE];
+		uint8_t prefix_index;
+	}bus;
+	
+}ssp_cold_str;
+
+typedef struct {
+	
+	// Shared by all links of a hub
+	const ssp_hub_str* hub;
+	ssp_pool_str* pool;
+	
+	// Running check of frame being encoded
+	uint32_t check;
+	
+	// Settings in use, hub ones or agreed by handshake
+	uint8_t framing;
+	uint8_t check_type;
+	uint8_t check_size;
+	uint8_t fec_size;
+	uint8_t control_size;
+	uint8_t peer_buffer_size;
+	bool compression : 1;
+	bool flow_control : 1;
+	
+	// Set once by SPP_Init
+	struct {
+		bool handshake : 1;
+		bool session : 1;
+		bool bus : 1;
+	}enabled;
+	
+	// Cold state block, POOL_NONE if none of its features used
+	uint16_t cold;
+	
+	struct {
+		uint8_t next;
+		uint8_t credit;
+	}schedule;
+	
+	// Messages from any thread. Producers push blocks on head,
+	// handler moves them to its own first - last list in order.
+	struct {
+		uint16_t head;
+		uint16_t first;
+		uint16_t last;
+	}queue;
+	
+	// All the halves share, each field written by one half only.
+	// Counters tell a new value from the old one.
+	struct {
+		// Receive half - ACK to send, ACK received, credits
+		uint8_t ack_id;
+		uint8_t ack_posted;
+		uint8_t acked_id;
+		uint8_t acked;
+		uint8_t repeats;
+		uint8_t credit;
+		uint8_t window;
+		
+		// Transmit half - ACKs sent, credit peer was told
+		uint8_t ack_sent;
+		uint8_t advertised;
+	}link;
+	
+	struct {
+		bool enabled;
+		bool flush;
+		uint16_t timeout;
+		uint8_t size;
+		uint8_t encoded_size;
+		uint16_t data;
+	}aggregation;
+	
+	struct {
+		const uint8_t* block;
+		uint8_t block_size;
+		uint8_t block_index;
+		
+		uint16_t buffer;
 		uint8_t index;
 		uint8_t size;
 		uint8_t id;
+		uint8_t control;
+		uint8_t last_received_id;
+		bool skip;
+		
+		uint16_t update_timeout;
+		
+		struct {
+			#if SSP_OWN_FIFO
+			uint8_t data[RX_FIFO_SIZE];
+			#else
+			uint16_t data;
+			#endif
+			uint16_t head;
+			uint16_t count;
+			uint8_t control;
+			uint8_t remaining;
+		}fifo;
 	}rx;
 
 	struct {
 		uint8_t counter;
 		uint8_t size;
-		uint8_t* data;
+		uint16_t data;
 		uint16_t timeout;
 		
-		ssp_frame_header_str ack;
 		struct {
-			bool ack_received;
 			uint8_t id;
 			uint8_t size;
-			uint8_t data[BUFFER_TOTAL_SIZE];
-		}frame;
+			uint16_t data;
+		}ack;
+		
+		// Frame on the wire (till ACKed) and the one encoded meanwhile
+		ssp_frame_str frame;
+		ssp_frame_str next;
+		
+		// Link counters already taken
+		struct {
+			uint8_t ack;
+			uint8_t acked;
+			uint8_t repeats;
+		}seen;
+		
+		bool next_ready : 1;
+		bool block_busy : 1;
+		volatile bool block_complete;
 	}tx;
 	
+	#if SSP_COMPACT == 0
+	// Used when no hub or pool given
+	struct {
+		ssp_hub_str hub;
+		ssp_cold_str cold;
+		uint8_t rx[BUFFER_TOTAL_SIZE];
+		uint8_t ack[ACK_SIZE_MAX];
+		#if SSP_AGGREGATION
+		uint8_t records[PAYLOAD_SIZE_MAX];
+		#endif
+		uint8_t frames[SSP_DOUBLE_BUFFER? 2 : 1][FRAME_BUFFER_SIZE];
+	}own;
+	#endif
+	
 }ssp_str;
 	
 typedef struct {
@@ -95,9 +455,124 @@ typedef struct {
 	bool (*INPUT_GetByte_)(uint8_t* value_ptr);
 	bool (*OUTPUT_PutByte_)(uint8_t value);
 	
+	ssp_framing_enum framing;
+	ssp_check_enum check_type;
+	
+	// Reed-Solomon parity bytes, 0 - disabled.
+	// Corrects up to fec_size / 2 damaged bytes per frame.
+	uint8_t fec_size;
+	
+	// LZ compression of each frame, raw if it does not shrink
+	bool compression;
+	
+	// Records from SPP_SendRecord packed into one frame. Frame is sent
+	// when aggregation_fill bytes collected, aggregation_delay handler 
+	// calls passed or SPP_Flush called. Zero fill - frame capacity.
+	// SPP_SendRecord and SPP_Flush share aggregation with the transmitter,
+	// call them from the thread running SPP_TxHandler (or SPP_Handler),
+	// other threads hand records over by SPP_Enqueue.
+	// Records delivered by OUTPUT_PutRecord_ (bytes to OUTPUT_PutByte_ if NULL).
+	bool aggregation;
+	uint8_t aggregation_fill;
+	uint16_t aggregation_delay;
+	bool (*OUTPUT_PutRecord_)(const uint8_t* data, uint8_t size);
+	
+	// Logical channels sharing the link, channel ID sent in control byte.
+	// Zero count - single channel of INPUT_GetByte_ and OUTPUT_PutByte_.
+	// Records from SPP_SendRecord always use channel 0.
+	uint8_t channels_count;
+	ssp_channel_str channels[CHANNELS_MAX];
+	
+	// Received payload buffered in RX_FIFO_SIZE FIFO, so UART is drained
+	// while output is busy. Free space advertised in every ACK as credit,
+	// frames are not sent until peer has room for them.
+	bool flow_control;
+	
+	// Transmit pacing, 0 baud - disabled. UART_PutByte_ gets no more bytes
+	// than line drains in pacing_latency microseconds, the rest waits for
+	// next handler call. TIME_GetMicros_ is a free running microsecond clock.
+	uint32_t baud_rate;
+	uint32_t pacing_latency;
+	uint32_t (*TIME_GetMicros_)(void);
+	
+	// Link setup. Settings above are the most this side allows, link starts
+	// in legacy format and switches to the best ones both sides share.
+	// Peer silent for HANDSHAKE_RETRIES hellos is taken as legacy one,
+	// link to it sends no records and channel 0 input only.
+	bool handshake;
+	
+	// Reset frame sent and acknowledged before first frame, so peer forgets
+	// IDs of previous session. Both sides must enable it.
+	bool session;
+	
+	// Keepalive ACK after keepalive idle handler calls, 0 - never.
+	// Peer dead after dead_timeout handler calls without valid frames, 0 - never.
+	// With dead_timeout peer counts as dead till its first valid frame.
+	uint16_t keepalive;
+	uint16_t dead_timeout;
+	
+	// RS-485 multi-drop bus. Frames start with raw [DST] [SRC] address bytes,
+	// frames for other nodes dropped before decoding. Node sends only while
+	// holding the token, its last frame or ACK passes token to the peer.
+	// Slave peer is the master address. Master keeps one ssp_str per slave,
+	// bus_peer - slave address, SPP_MasterHandler polls them in turn and
+	// waits bus_timeout handler calls for slave answer. No handshake on bus.
+	bool bus;
+	bool bus_master;
+	uint8_t bus_address;
+	uint8_t bus_peer;
+	uint16_t bus_timeout;
+	
+	// Block transmit (DMA, write(2)), replaces UART_PutByte_ if set.
+	// Whole encoded frame or ACK given at once, buffer is left untouched
+	// till SPP_TransmitComplete, next frame is encoded meanwhile.
+	// No pacing, engine keeps line rate itself. Needs SSP_DOUBLE_BUFFER or pool.
+	bool (*UART_PutBlock_)(const uint8_t* data, uint8_t size);
+	
+	// Block receive, replaces UART_GetByte_ if set. UART_GetBlock_ gives
+	// filled buffer (NULL if none), it is parsed till END at once and
+	// handed back by UART_ReleaseBlock_ when all bytes are taken.
+	const uint8_t* (*UART_GetBlock_)(uint8_t* size_ptr);
+	void (*UART_ReleaseBlock_)(const uint8_t* data);
+	
+	// Hub of many identical links. Callbacks, channels, framing, check,
+	// FEC, aggregation fill and delay, keepalive, dead and bus timeouts
+	// and pacing above are taken from hub made by SPP_HubInit instead.
+	// Frame, ACK, receive and record buffers are taken from pool while in
+	// use and given back when idle, link gets no frames while pool is empty.
+	// Handshake, session, bus, keepalive and pacing state is one more block
+	// SPP_Init takes for good, it fails if pool is empty.
+	// Both required if SSP_COMPACT.
+	// Pool also carries messages SPP_Enqueue takes from any thread without
+	// locks, handler sends them as records (aggregation needed). Message
+	// refused if its record may not fit a frame, still dropped if peer
+	// turns out to be legacy or to have smaller buffer.
+	const ssp_hub_str* hub;
+	ssp_pool_str* pool;
+
 }ssp_init_str;
 
+typedef struct {
+	
+	ssp_str* const* nodes;
+	uint8_t count;
+	uint8_t current;
+	
+}ssp_master_str;
+
 bool SPP_Init(ssp_str* const ssp, const ssp_init_str* const config);
 void SPP_Handler(ssp_str* ssp);
+void SPP_RxHandler(ssp_str* const ssp);
+void SPP_TxHandler(ssp_str* const ssp);
+// Transmitter thread only, SPP_Enqueue from others
+bool SPP_SendRecord(ssp_str* const ssp, const uint8_t* data, uint8_t size);
+void SPP_Flush(ssp_str* const ssp);
+bool SPP_IsPeerAlive(const ssp_str* const ssp);
+void SPP_MasterHandler(ssp_master_str* const master);
+void SPP_TransmitComplete(ssp_str* const ssp);
+bool SPP_HubInit(ssp_hub_str* const hub, const ssp_init_str* const config);
+bool SPP_PoolInit(ssp_pool_str* const pool, uint8_t (*blocks)[POOL_BLOCK_SIZE], uint16_t* next, uint16_t count);
+uint16_t SPP_PoolAvailable(const ssp_pool_str* const pool);
+bool SPP_Enqueue(ssp_str* const ssp, const uint8_t* data, uint8_t size);
 	
 #endif /* SSP_H_ */
\ No newline at end of file
@@ -22,6 +22,31 @@ void test_setup_transmitter_frame(void);
 void test_send_frame(void);
 void test_send_ack(void);
 void test_reception(void);
+void test_cobs_worst_case(void);
+void test_damaged_end(void);
+void test_cobs_reception(void);
+void test_check_vectors(void);
+void test_check_reception(void);
+void test_fec_correction(void);
+void test_compression(void);
+void test_compression_reception(void);
+void test_aggregation(void);
+void test_aggregation_policy(void);
+void test_channels_priority(void);
+void test_channels_weight(void);
+void test_channels_unknown(void);
+void test_flow_control(void);
+void test_pacing(void);
+void test_handshake(void);
+void test_handshake_fallback(void);
+void test_handshake_legacy(void);
+void test_session(void);
+void test_bus(void);
+void test_dma(void);
+void test_dma_priority(void);
+void test_pool(void);
+void test_queue(void);
+void test_split_handlers(void);
 
 void test_reception(void)
 {
@@ -69,6 +94,1049 @@ void test_reception(void)
 		case BROKEN_RECEIVED: TEST_FAIL_MESSAGE("Unexpected broken message received!"); break;
 		case FRAME_RECEIVED: break;
 	}
+	
+	// Collisions resolved on output
+	TEST_ASSERT_TRUE(PushAllReceivedData(ssp));
+	TEST_ASSERT_EQUAL_UINT8(payload_size, test_serial_rxed_index);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(source_arr, test_serial_rxed_array, payload_size);
+}
+
+void test_cobs_worst_case(void)
+{
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS });
+	
+	// All 0xFF - worst case for escaping
+	memset(test_serial_to_tx_array, 0xFF, COBS_INPUT_DATA_SIZE_MAX);
+	test_serial_to_tx_len = COBS_INPUT_DATA_SIZE_MAX;
+	
+	TEST_ASSERT_TRUE(CreateFrameIn(ssp));
+	
+	// Whole input in one frame, single code byte overhead
+	TEST_ASSERT_EQUAL_UINT8(0, test_serial_to_tx_len);
+	TEST_ASSERT_EQUAL_UINT8(COBS_INPUT_DATA_SIZE_MAX + HEADER_SIZE + 1, ssp->tx.frame.size);
+	TEST_ASSERT_LESS_OR_EQUAL_UINT8(BUFFER_TOTAL_SIZE, ssp->tx.frame.size);
+	
+	// END appears only once
+	for(uint8_t i = 0; i < ssp->tx.frame.size - 1; i++){
+		TEST_ASSERT_NOT_EQUAL_UINT8(END_MARKER, Block_(ssp, ssp->tx.frame.data)[i]);
+	}
+	TEST_ASSERT_EQUAL_UINT8(END_MARKER, Block_(ssp, ssp->tx.frame.data)[ssp->tx.frame.size - 1]);
+}
+
+void test_damaged_end(void)
+{
+	// Frame after one with damaged END is found back from its own END,
+	// both together overflow receiver buffer
+	const ssp_check_enum checks[] = { SSP_CHECK_CRC8, SSP_CHECK_CRC16 };
+	const uint8_t fec_sizes[] = { 0, 4 };
+	
+	for(uint8_t c = 0; c < 2; c++){
+		for(uint8_t f = 0; f < 2; f++){
+			Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_ESCAPE, .check_type = checks[c], 
+				.fec_size = fec_sizes[f] });
+			for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = 0xA0 + i; }
+			test_serial_to_tx_index = 0;
+			
+			uint8_t wire_size = 0;
+			uint8_t first = 0;
+			uint8_t taken = 0;
+			for(uint8_t n = 0; n < 2; n++){
+				first = test_serial_to_tx_index;
+				test_serial_to_tx_len = 128;
+				TEST_ASSERT_TRUE(CreateFrameIn(ssp));
+				taken = 128 - test_serial_to_tx_len;
+				memcpy(&test_uart_array[wire_size], Block_(ssp, ssp->tx.frame.data), ssp->tx.frame.size);
+				wire_size += ssp->tx.frame.size;
+			}
+			TEST_ASSERT_GREATER_THAN(BUFFER_TOTAL_SIZE, wire_size);
+			
+			// END of the first one damaged
+			test_uart_array[wire_size - ssp->tx.frame.size - 1] ^= 0x01;
+			test_uart_txed_index = 0;
+			test_uart_len = wire_size;
+			test_serial_rxed_index = 0;
+			
+			TEST_ASSERT_EQUAL(FRAME_RECEIVED, ReceiveAll());
+			TEST_ASSERT_EQUAL_UINT8(ssp->tx.frame.id, ssp->rx.id);
+			TEST_ASSERT_TRUE(PushAllReceivedData(ssp));
+			TEST_ASSERT_EQUAL_UINT8(taken, test_serial_rxed_index);
+			TEST_ASSERT_EQUAL_UINT8_ARRAY(&test_serial_to_tx_array[first], test_serial_rxed_array, taken);
+
+			// ACK right after line garbage, whatever its length
+			for(uint8_t garbage = 1; garbage <= 8; garbage++){
+				CreateAck_(ssp, 42);
+				for(uint8_t i = 0; i < garbage; i++){ test_uart_array[i] = 0x11 * (i + 1); }
+				memcpy(&test_uart_array[garbage], Block_(ssp, ssp->tx.ack.data), ssp->tx.ack.size);
+				test_uart_txed_index = 0;
+				test_uart_len = garbage + ssp->tx.ack.size;
+
+				TEST_ASSERT_EQUAL(ACK_RECEIVED, ReceiveAll());
+				TEST_ASSERT_EQUAL_UINT8(42, ssp->rx.id);
+			}
+		}
+	}
+}
+
+void test_cobs_reception(void)
+{
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS });
+	
+	uint8_t source_arr[COBS_INPUT_DATA_SIZE_MAX];
+	for(uint8_t i = 0; i < sizeof(source_arr); i++){
+		source_arr[i] = (i % 3 == 0)? 0xFF : (i % 5 == 0)? 0xAA : i;
+	}
+	memcpy(test_serial_to_tx_array, source_arr, sizeof(source_arr));
+	test_serial_to_tx_len = sizeof(source_arr);
+	
+	// Frame
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(ssp->tx.frame.size, test_uart_rxed_index);
+	
+	TEST_ASSERT_EQUAL(FRAME_RECEIVED, ReceiveAll());
+	TEST_ASSERT_EQUAL_UINT8(ssp->tx.frame.id, ssp->rx.id);
+	TEST_ASSERT_TRUE(PushAllReceivedData(ssp));
+	TEST_ASSERT_EQUAL_UINT8(sizeof(source_arr), test_serial_rxed_index);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(source_arr, test_serial_rxed_array, sizeof(source_arr));
+	
+	// ACK
+	ssp->tx.ack.id = ssp->rx.id;
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	
+	TEST_ASSERT_EQUAL(ACK_RECEIVED, ReceiveAll());
+	TEST_ASSERT_EQUAL_UINT8(ssp->tx.frame.id, ssp->rx.id);
+}
+
+void test_check_vectors(void)
+{
+	const uint8_t data[] = "123456789";
+	
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_ESCAPE, .check_type = SSP_CHECK_CRC16 });
+	TEST_ASSERT_EQUAL_HEX16(0x29B1, CalculateCheck_(ssp, data, 9));
+	
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_ESCAPE, .check_type = SSP_CHECK_CRC32C });
+	TEST_ASSERT_EQUAL_HEX32(0xE3069283, CalculateCheck_(ssp, data, 9));
+	
+	// Block and byte by byte calculation match
+	ResetCheck(ssp);
+	for(uint8_t i = 0; i < 9; i++) { PushCheck(ssp, data[i]); }
+	TEST_ASSERT_EQUAL_HEX32(0xE3069283, GetCheck(ssp));
+}
+
+void test_check_reception(void)
+{
+	uint8_t source_arr[COBS_INPUT_DATA_SIZE_MAX];
+	for(uint8_t i = 0; i < sizeof(source_arr); i++){
+		source_arr[i] = (i % 2 == 0)? 0xFF : 0xAA;
+	}
+	
+	const ssp_check_enum checks[] = { SSP_CHECK_CRC8, SSP_CHECK_CRC16, SSP_CHECK_CRC32C };
+	const ssp_framing_enum framings[] = { SSP_FRAMING_ESCAPE, SSP_FRAMING_COBS };
+	
+	for(uint8_t c = 0; c < 3; c++){
+		for(uint8_t f = 0; f < 2; f++){
+			setUp();
+			Initialize(&(ssp_init_str){ .framing = framings[f], .check_type = checks[c] });
+			
+			// Worst case input fits into single frame
+			uint8_t size = GetInputSizeMax_(ssp);
+			if(framings[f] == SSP_FRAMING_ESCAPE) { size /= COLLISION_SIZE; }
+			RunLoopback(source_arr, size);
+			TEST_ASSERT_LESS_OR_EQUAL_UINT8(BUFFER_TOTAL_SIZE, ssp->tx.frame.size);
+			
+			// Corrupted check drops the frame
+			ssp->tx.counter = 0;
+			Block_(ssp, ssp->tx.frame.data)[ssp->tx.frame.size - 2] ^= 0x01;
+			SetupTransmitterForFrame_(ssp);
+			TEST_ASSERT_TRUE(PushAllToOutput_(ssp));
+			TEST_ASSERT_EQUAL(BROKEN_RECEIVED, ReceiveAll());
+		}
+	}
+}
+
+void test_fec_correction(void)
+{
+	uint8_t source_arr[40];
+	for(uint8_t i = 0; i < sizeof(source_arr); i++){ source_arr[i] = i + 1; }
+	
+	const ssp_framing_enum framings[] = { SSP_FRAMING_ESCAPE, SSP_FRAMING_COBS };
+	
+	for(uint8_t f = 0; f < 2; f++){
+		for(uint8_t damaged = 0; damaged <= 3; damaged++){
+			setUp();
+			Initialize(&(ssp_init_str){ .framing = framings[f], .check_type = SSP_CHECK_CRC16, .fec_size = 4 });
+			
+			memcpy(test_serial_to_tx_array, source_arr, sizeof(source_arr));
+			test_serial_to_tx_len = sizeof(source_arr);
+			TEST_ASSERT_TRUE(CreateFrameIn(ssp));
+			
+			// Damage data bytes only, framing symbols untouched
+			for(uint8_t i = 0; i < damaged; i++){ Block_(ssp, ssp->tx.frame.data)[1 + i * 7] ^= 0x10; }
+			
+			SetupTransmitterForFrame_(ssp);
+			TEST_ASSERT_TRUE(PushAllToOutput_(ssp));
+			
+			// Up to fec_size / 2 bytes corrected
+			if(damaged <= 2){
+				TEST_ASSERT_EQUAL(FRAME_RECEIVED, ReceiveAll());
+				TEST_ASSERT_TRUE(PushAllReceivedData(ssp));
+				TEST_ASSERT_EQUAL_UINT8(sizeof(source_arr), test_serial_rxed_index);
+				TEST_ASSERT_EQUAL_UINT8_ARRAY(source_arr, test_serial_rxed_array, sizeof(source_arr));
+			}
+			else { TEST_ASSERT_EQUAL(BROKEN_RECEIVED, ReceiveAll()); }
+		}
+	}
+	
+	// ACK protected as well
+	setUp();
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16, .fec_size = FEC_SIZE_MAX });
+	CreateAck_(ssp, 42);
+	Block_(ssp, ssp->tx.ack.data)[2] ^= 0x01;
+	SetupTransmitterForAck_(ssp);
+	TEST_ASSERT_TRUE(PushAllToOutput_(ssp));
+	TEST_ASSERT_EQUAL(ACK_RECEIVED, ReceiveAll());
+	TEST_ASSERT_EQUAL_UINT8(42, ssp->rx.id);
+}
+
+void test_compression(void)
+{
+	uint8_t source_arr[PAYLOAD_SIZE_MAX];
+	uint8_t packed[PAYLOAD_SIZE_MAX];
+	uint8_t unpacked[PAYLOAD_SIZE_MAX];
+	
+	// Overlapping match - run of single byte
+	memset(source_arr, 0xFF, sizeof(source_arr));
+	uint8_t packed_size = Compress_(source_arr, sizeof(source_arr), packed, sizeof(packed));
+	TEST_ASSERT_GREATER_THAN_UINT8(0, packed_size);
+	TEST_ASSERT_LESS_THAN(8, packed_size);
+	TEST_ASSERT_EQUAL_UINT8(sizeof(source_arr), 
+		Decompress_(packed, packed_size, unpacked, sizeof(unpacked)));
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(source_arr, unpacked, sizeof(source_arr));
+	
+	// Incompressible data does not fit into limit
+	for(uint8_t i = 0; i < sizeof(source_arr); i++){ source_arr[i] = i; }
+	TEST_ASSERT_EQUAL_UINT8(0, Compress_(source_arr, sizeof(source_arr), packed, sizeof(source_arr) - 1));
+	
+	// Damaged match never reads outside of output
+	const uint8_t broken[] = { 0x01, 0x05, 0x00 };
+	TEST_ASSERT_EQUAL_UINT8(0, Decompress_(broken, sizeof(broken), unpacked, sizeof(unpacked)));
+}
+
+void test_compression_reception(void)
+{
+	// Repeated telemetry records
+	uint8_t source_arr[36];
+	for(uint8_t i = 0; i < sizeof(source_arr); i++){
+		const uint8_t record[] = { 0x10, 0xAA, 0x00, 0xFF, 0x20, 0x31 };
+		source_arr[i] = record[i % sizeof(record)];
+	}
+	
+	const ssp_framing_enum framings[] = { SSP_FRAMING_ESCAPE, SSP_FRAMING_COBS };
+	
+	for(uint8_t f = 0; f < 2; f++){
+		setUp();
+		Initialize(&(ssp_init_str){ .framing = framings[f], .check_type = SSP_CHECK_CRC16 });
+		RunLoopback(source_arr, sizeof(source_arr));
+		const uint8_t raw_frame_size = ssp->tx.frame.size;
+		
+		setUp();
+		Initialize(&(ssp_init_str){ .framing = framings[f], .check_type = SSP_CHECK_CRC16, .compression = true });
+		RunLoopback(source_arr, sizeof(source_arr));
+		TEST_ASSERT_EQUAL_HEX8(CONTROL_COMPRESSED, ssp->rx.control);
+		TEST_ASSERT_LESS_THAN(raw_frame_size / 2, ssp->tx.frame.size);
+		
+		// Frame which does not shrink is sent raw
+		uint8_t random_arr[20] = { 35, 125, 159, 193, 66, 28, 254, 160, 225, 191,
+								   93, 3, 128, 222, 60, 98, 190, 224, 2, 92 };
+		setUp();
+		Initialize(&(ssp_init_str){ .framing = framings[f], .check_type = SSP_CHECK_CRC16, .compression = true });
+		RunLoopback(random_arr, sizeof(random_arr));
+		TEST_ASSERT_EQUAL_HEX8(0, ssp->rx.control);
+	}
+}
+
+void test_aggregation(void)
+{
+	const ssp_framing_enum framings[] = { SSP_FRAMING_ESCAPE, SSP_FRAMING_COBS };
+	
+	for(uint8_t f = 0; f < 2; f++){
+		setUp();
+		Initialize(&(ssp_init_str){ .framing = framings[f], .check_type = SSP_CHECK_CRC16, 
+		.aggregation = true, .aggregation_fill = 0, .aggregation_delay = 0, 
+		.OUTPUT_PutRecord_ = TEST_SERIAL_PutRecord });
+		
+		// Records are accepted till frame is full
+		uint8_t expected[PAYLOAD_SIZE_MAX];
+		uint8_t expected_size = 0;
+		uint8_t records = 0;
+		uint8_t record[3] = { 0xFF, 0, 0xAA };
+		
+		for(; records < 20; records++){
+			record[1] = records;
+			if(not SPP_SendRecord(ssp, record, sizeof(record))) { break; }
+			expected[expected_size++] = sizeof(record);
+			memcpy(&expected[expected_size], record, sizeof(record));
+			expected_size += sizeof(record);
+		}
+		TEST_ASSERT_GREATER_THAN_UINT8(4, records);
+		
+		// One frame for all of them
+		TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+		TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+		TEST_ASSERT_EQUAL_UINT8(ssp->tx.frame.size, test_uart_rxed_index);
+		TEST_ASSERT_LESS_OR_EQUAL_UINT8(BUFFER_TOTAL_SIZE, ssp->tx.frame.size);
+		TEST_ASSERT_EQUAL_UINT8(0, ssp->aggregation.size);
+		
+		TEST_ASSERT_EQUAL(FRAME_RECEIVED, ReceiveAll());
+		TEST_ASSERT_EQUAL_HEX8(CONTROL_AGGREGATED, ssp->rx.control);
+		
+		// Output refusal keeps delivered records
+		test_records_refused = 1;
+		TEST_ASSERT_FALSE(PushAllReceivedData(ssp));
+		TEST_ASSERT_TRUE(PushAllReceivedData(ssp));
+		
+		TEST_ASSERT_EQUAL_UINT8(records, test_records_count);
+		TEST_ASSERT_EQUAL_UINT8(expected_size, test_serial_rxed_index);
+		TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, test_serial_rxed_array, expected_size);
+	}
+}
+
+void test_aggregation_policy(void)
+{
+	const uint8_t record[2] = { 1, 2 };
+	
+	// Waits for fill or delay
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16, 
+		.aggregation = true, .aggregation_fill = 9, .aggregation_delay = 10, 
+		.OUTPUT_PutRecord_ = TEST_SERIAL_PutRecord });
+	TEST_ASSERT_TRUE(SPP_SendRecord(ssp, record, sizeof(record)));
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(0, test_uart_rxed_index);
+	
+	// Fill reached
+	TEST_ASSERT_TRUE(SPP_SendRecord(ssp, record, sizeof(record)));
+	TEST_ASSERT_TRUE(SPP_SendRecord(ssp, record, sizeof(record)));
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(ssp->tx.frame.size, test_uart_rxed_index);
+	
+	// Delay expired
+	setUp();
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16, 
+		.aggregation = true, .aggregation_fill = 0, .aggregation_delay = 10, 
+		.OUTPUT_PutRecord_ = TEST_SERIAL_PutRecord });
+	TEST_ASSERT_TRUE(SPP_SendRecord(ssp, record, sizeof(record)));
+	for(uint8_t i = 0; i < 9; i++) { TEST_ASSERT_TRUE(TransmissionHandler_(ssp)); }
+	TEST_ASSERT_EQUAL_UINT8(0, test_uart_rxed_index);
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(ssp->tx.frame.size, test_uart_rxed_index);
+	
+	// Explicit flush
+	setUp();
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16, 
+		.aggregation = true, .aggregation_fill = 0, .aggregation_delay = 1000, 
+		.OUTPUT_PutRecord_ = TEST_SERIAL_PutRecord });
+	TEST_ASSERT_TRUE(SPP_SendRecord(ssp, record, sizeof(record)));
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(0, test_uart_rxed_index);
+	SPP_Flush(ssp);
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(ssp->tx.frame.size, test_uart_rxed_index);
+	
+	// Empty record refused
+	TEST_ASSERT_FALSE(SPP_SendRecord(ssp, record, 0));
+}
+
+void test_channels_priority(void)
+{
+	// Bulk on serial, urgent control
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16,
+		.channels_count = 2, .channels = {
+			{ TEST_SERIAL_GetByte, TEST_SERIAL_PutByte, 1, 1 },
+			{ TEST_CONTROL_GetByte, TEST_CONTROL_PutByte, 0, 1 } } });
+	memset(test_serial_to_tx_array, 0x55, 128);
+	test_serial_to_tx_len = 1000;
+	test_control_to_tx_len = 3;
+	
+	TEST_ASSERT_TRUE(CreateFrameIn(ssp));
+	TEST_ASSERT_EQUAL_UINT8(0, test_control_to_tx_len);
+	TEST_ASSERT_EQUAL_UINT(1000, test_serial_to_tx_len);
+	
+	// Received by control output only
+	SetupTransmitterForFrame_(ssp);
+	TEST_ASSERT_TRUE(PushAllToOutput_(ssp));
+	TEST_ASSERT_EQUAL(FRAME_RECEIVED, ReceiveAll());
+	TEST_ASSERT_TRUE(PushAllReceivedData(ssp));
+	TEST_ASSERT_EQUAL_UINT8(3, test_control_rxed_index);
+	TEST_ASSERT_EQUAL_HEX8(0xC3, test_control_rxed_array[0]);
+	TEST_ASSERT_EQUAL_UINT8(0, test_serial_rxed_index);
+	
+	// Bulk continues when control is empty, control preempts at next frame
+	TEST_ASSERT_TRUE(CreateFrameIn(ssp));
+	TEST_ASSERT_LESS_THAN(1000, test_serial_to_tx_len);
+	test_control_to_tx_len = 1;
+	TEST_ASSERT_TRUE(CreateFrameIn(ssp));
+	TEST_ASSERT_EQUAL_UINT8(0, test_control_to_tx_len);
+	
+	SetupTransmitterForFrame_(ssp);
+	TEST_ASSERT_TRUE(PushAllToOutput_(ssp));
+	TEST_ASSERT_EQUAL(FRAME_RECEIVED, ReceiveAll());
+	TEST_ASSERT_EQUAL_HEX8(1 << CONTROL_CHANNEL_SHIFT, ssp->rx.control);
+
+	// Records wait behind channel of higher priority than channel 0
+	setUp();
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16,
+		.aggregation = true, .aggregation_fill = 0, .aggregation_delay = 0,
+		.OUTPUT_PutRecord_ = TEST_SERIAL_PutRecord,
+		.channels_count = 2, .channels = {
+			{ TEST_SERIAL_GetByte, TEST_SERIAL_PutByte, 1, 1 },
+			{ TEST_CONTROL_GetByte, TEST_CONTROL_PutByte, 0, 1 } } });
+	TEST_ASSERT_TRUE(SPP_SendRecord(ssp, (uint8_t[]){ 1, 2 }, 2));
+	test_control_to_tx_len = 3;
+
+	TEST_ASSERT_TRUE(CreateFrameIn(ssp));
+	TEST_ASSERT_EQUAL_UINT8(0, test_control_to_tx_len);
+	TEST_ASSERT_NOT_EQUAL(0, ssp->aggregation.size);
+	TEST_ASSERT_EQUAL_UINT8(0, ssp->tx.frame.priority);
+
+	ReleaseFrame_(ssp);
+	TEST_ASSERT_TRUE(CreateFrameIn(ssp));
+	TEST_ASSERT_EQUAL_UINT8(0, ssp->aggregation.size);
+	TEST_ASSERT_EQUAL_UINT8(1, ssp->tx.frame.priority);
+}
+
+void test_channels_weight(void)
+{
+	// Equal priority, serial gets two frames per control one
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16,
+		.channels_count = 2, .channels = {
+			{ TEST_SERIAL_GetByte, TEST_SERIAL_PutByte, 0, 2 },
+			{ TEST_CONTROL_GetByte, TEST_CONTROL_PutByte, 0, 1 } } });
+	memset(test_serial_to_tx_array, 0x55, 128);
+	
+	uint8_t sequence[6];
+	for(uint8_t i = 0; i < sizeof(sequence); i++){
+		test_serial_to_tx_len = 1;
+		test_control_to_tx_len = 1;
+		sequence[i] = ScheduleChannel_(ssp, &(uint8_t){ 0 }, PRIORITY_ANY, PAYLOAD_SIZE_MAX);
+	}
+	
+	const uint8_t expected[6] = { 0, 0, 1, 0, 0, 1 };
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, sequence, sizeof(expected));
+	
+	// Idle channel does not hold the link
+	test_serial_to_tx_len = 0;
+	test_control_to_tx_len = 1;
+	TEST_ASSERT_EQUAL_UINT8(1, ScheduleChannel_(ssp, &(uint8_t){ 0 }, PRIORITY_ANY, PAYLOAD_SIZE_MAX));
+	TEST_ASSERT_EQUAL_UINT8(CHANNEL_NONE, ScheduleChannel_(ssp, &(uint8_t){ 0 }, PRIORITY_ANY, PAYLOAD_SIZE_MAX));
+}
+
+void test_channels_unknown(void)
+{
+	// Peer knows only first channel
+	InitializeLinkSide(ssp, &(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16,
+		.channels_count = 2, .channels = {
+			{ TEST_SERIAL_GetByte, TEST_CONTROL_PutByte, 0, 1 },
+			{ TEST_CONTROL_GetByte, TEST_CONTROL_PutByte, 0, 1 } } });
+	InitializeLinkSide(ssp_peer, &(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16,
+		.aggregation = true, .channels_count = 1, .channels = {
+			{ NULL, TEST_SERIAL_PutByte, 0, 1 } } });
+	for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = i; }
+	
+	// Its frames are acknowledged and dropped, link goes on
+	test_serial_to_tx_len = 100;
+	test_control_to_tx_len = 50;
+	RunLink(2000, true);
+	TEST_ASSERT_EQUAL(0, test_control_to_tx_len);
+	TEST_ASSERT_EQUAL(0, test_serial_to_tx_len);
+	TEST_ASSERT_EQUAL_UINT8(100, test_serial_rxed_index);
+	for(uint8_t i = 0; i < 100; i++){ TEST_ASSERT_EQUAL_UINT8(i, test_serial_rxed_array[i]); }
+}
+
+void test_flow_control(void)
+{
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16,
+		.flow_control = true, .UART_GetByte_ = TEST_LOOP_GetByte, .UART_PutByte_ = TEST_LOOP_PutByte });
+	
+	for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = i; }
+	const uint16_t total_size = 250;
+	test_serial_to_tx_len = total_size;
+	
+	// Output stalled
+	test_serial_rxed_len = 0;
+	for(uint16_t i = 0; i < 3000; i++){ SPP_Handler(ssp); }
+	
+	// Sender stopped by credits, not more than FIFO taken
+	uint16_t taken = total_size - test_serial_to_tx_len;
+	TEST_ASSERT_GREATER_THAN(0, taken);
+	TEST_ASSERT_LESS_OR_EQUAL(RX_FIFO_SIZE, taken);
+	TEST_ASSERT_LESS_THAN(GetInputSizeMax_(ssp), ssp->link.credit);
+	TEST_ASSERT_GREATER_THAN(taken, ssp->rx.fifo.count);
+	
+	// UART drained while output stalled
+	TEST_ASSERT_EQUAL(0, test_loop_count);
+	
+	// Output released - window updates restart sender
+	test_serial_rxed_len = 4096;
+	for(uint16_t i = 0; i < 20000; i++){ SPP_Handler(ssp); }
+	
+	TEST_ASSERT_EQUAL(0, test_serial_to_tx_len);
+	TEST_ASSERT_EQUAL(0, ssp->rx.fifo.count);
+	TEST_ASSERT_EQUAL(total_size, 4096 - test_serial_rxed_len);
+	for(uint16_t i = 0; i < total_size; i++){
+		TEST_ASSERT_EQUAL_UINT8(i & 127, test_serial_rxed_array[i]);
+	}
+}
+
+void test_pacing(void)
+{
+	// 1000 bytes per second, 4 ms queue - 4 bytes in driver at most
+	Initialize(&(ssp_init_str){ .baud_rate = 10000, .pacing_latency = 4000, 
+		.TIME_GetMicros_ = TEST_TIME_GetMicros });
+	memset(test_serial_to_tx_array, 0x55, 20);
+	test_serial_to_tx_len = 20;
+	const uint8_t frame_size = 20 + HEADER_SIZE;
+	
+	TEST_ASSERT_TRUE(CreateFrameIn(ssp));
+	SetupTransmitterForFrame_(ssp);
+	
+	// Full bucket, then nothing until line drains
+	TEST_ASSERT_FALSE(PushAllToOutput_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(4, test_uart_rxed_index);
+	TEST_ASSERT_FALSE(PushAllToOutput_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(4, test_uart_rxed_index);
+	
+	// Byte per millisecond
+	test_time_us += 2500;
+	TEST_ASSERT_FALSE(PushAllToOutput_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(6, test_uart_rxed_index);
+	
+	// Fraction kept
+	test_time_us += 500;
+	TEST_ASSERT_FALSE(PushAllToOutput_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(7, test_uart_rxed_index);
+	
+	// Idle line does not store more than the depth, clock wraps
+	test_time_us = UINT32_MAX - 100;
+	TEST_ASSERT_FALSE(PushAllToOutput_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(11, test_uart_rxed_index);
+	
+	test_time_us = 1000000;
+	TEST_ASSERT_FALSE(PushAllToOutput_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(15, test_uart_rxed_index);
+	
+	// Polled every millisecond - line rate
+	for(uint8_t i = 15; i < frame_size - 1; i++){
+		test_time_us += 1000;
+		TEST_ASSERT_FALSE(PushAllToOutput_(ssp));
+		TEST_ASSERT_EQUAL_UINT8(i + 1, test_uart_rxed_index);
+	}
+	test_time_us += 1000;
+	TEST_ASSERT_TRUE(PushAllToOutput_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(frame_size, test_uart_rxed_index);
+	
+	// Clock is required
+	ssp_init_str config = ssp_config_structure;
+	config.baud_rate = 10000;
+	TEST_ASSERT_FALSE(InitializeLink(ssp, &config));
+}
+
+void test_handshake(void)
+{
+	// Talking to itself - own settings are the shared ones
+	ssp_init_str config = { .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC32C,
+		.fec_size = 4, .compression = true, .flow_control = true, .handshake = true,
+		.UART_GetByte_ = TEST_LOOP_GetByte, .UART_PutByte_ = TEST_LOOP_PutByte };
+	Initialize(&config);
+	for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = i; }
+	test_serial_to_tx_len = 20;
+	
+	// Frames wait for agreement
+	TEST_ASSERT_TRUE(IsLegacyFrame(ssp));
+	for(uint16_t i = 0; i < 200 and not Cold_(ssp)->handshake.done; i++){ SPP_Handler(ssp); }
+	
+	TEST_ASSERT_TRUE(Cold_(ssp)->handshake.done);
+	TEST_ASSERT_EQUAL(SSP_FRAMING_COBS, ssp->framing);
+	TEST_ASSERT_EQUAL(SSP_CHECK_CRC32C, ssp->check_type);
+	TEST_ASSERT_EQUAL_UINT8(4, ssp->fec_size);
+	TEST_ASSERT_TRUE(ssp->compression);
+	TEST_ASSERT_TRUE(ssp->flow_control);
+	TEST_ASSERT_EQUAL_UINT8(CONTROL_SIZE, ssp->control_size);
+	
+	for(uint16_t i = 0; i < 200; i++){ SPP_Handler(ssp); }
+	TEST_ASSERT_EQUAL(0, test_serial_to_tx_len);
+	TEST_ASSERT_EQUAL_UINT8(20, test_serial_rxed_index);
+	for(uint8_t i = 0; i < 20; i++){ TEST_ASSERT_EQUAL_UINT8(i, test_serial_rxed_array[i]); }
+	
+	// Smaller peer: no COBS, compression and flow control, CRC16 only
+	Initialize(&config);
+	const uint8_t hello[HELLO_SIZE] = { SSP_VERSION, HELLO_SEEN | HELLO_DONE, CAP_CRC16, 48, 100, 2 };
+	TEST_ASSERT_TRUE(TakeBlock_(ssp, &ssp->rx.buffer));
+	memcpy(Block_(ssp, ssp->rx.buffer), hello, HELLO_SIZE);
+	HandshakeReceived_(ssp);
+	
+	TEST_ASSERT_TRUE(Cold_(ssp)->handshake.done);
+	TEST_ASSERT_FALSE(Cold_(ssp)->handshake.reply);
+	TEST_ASSERT_EQUAL(SSP_FRAMING_ESCAPE, ssp->framing);
+	TEST_ASSERT_EQUAL(SSP_CHECK_CRC16, ssp->check_type);
+	TEST_ASSERT_EQUAL_UINT8(2, ssp->fec_size);
+	TEST_ASSERT_FALSE(ssp->compression);
+	TEST_ASSERT_FALSE(ssp->flow_control);
+	TEST_ASSERT_EQUAL_UINT8(0, ssp->control_size);
+	TEST_ASSERT_EQUAL_UINT8(48 - (HEADER_SIZE - CRC8_SIZE) - (2 + 2) * COLLISION_SIZE, 
+							GetInputSizeMax_(ssp));
+	
+	// Restarted peer stops frames till agreed again
+	Block_(ssp, ssp->rx.buffer)[1] = 0;
+	HandshakeReceived_(ssp);
+	TEST_ASSERT_FALSE(Cold_(ssp)->handshake.done);
+	TEST_ASSERT_TRUE(Cold_(ssp)->handshake.reply);
+}
+
+void test_handshake_fallback(void)
+{
+	// Peer without handshake drops hello
+	InitializeLinkSide(ssp_peer, &(ssp_init_str){ .handshake = true });
+	CreateHello_(ssp_peer);
+	memcpy(test_uart_array, Block_(ssp_peer, ssp_peer->tx.ack.data), ssp_peer->tx.ack.size);
+	test_uart_len = ssp_peer->tx.ack.size;
+	TEST_ASSERT_EQUAL(BROKEN_RECEIVED, ReceiveAll());
+	
+	// And never answers - legacy format after retries
+	ssp_init_str config = { .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC32C,
+		.fec_size = 4, .compression = true, .flow_control = true, .handshake = true,
+		.UART_GetByte_ = TEST_CONTROL_GetByte, .UART_PutByte_ = TEST_UART_PutByte };
+	Initialize(&config);
+	test_uart_len = 4096;
+	for(uint32_t i = 0; i < (HANDSHAKE_RETRIES + 1) * (TX_TIMEOUT + 1); i++){ SPP_Handler(ssp); }
+	
+	TEST_ASSERT_TRUE(Cold_(ssp)->handshake.done);
+	TEST_ASSERT_FALSE(Cold_(ssp)->handshake.known);
+	TEST_ASSERT_TRUE(IsLegacyFrame(ssp));
+	
+	uint8_t hellos = 0;
+	for(uint8_t i = 0; i < test_uart_rxed_index; i++){
+		if(test_uart_array[i] == END_MARKER) { hellos++; }
+	}
+	TEST_ASSERT_EQUAL_UINT8(HANDSHAKE_RETRIES, hellos);
+}
+
+void test_handshake_legacy(void)
+{
+	// Records and second channel need control byte legacy peer lacks
+	InitializeLinkSide(ssp, &(ssp_init_str){ .handshake = true, .aggregation = true,
+		.OUTPUT_PutRecord_ = TEST_SERIAL_PutRecord, .channels_count = 2, .channels = {
+			{ TEST_SERIAL_GetByte, TEST_CONTROL_PutByte, 1, 1 },
+			{ TEST_LOOP_GetByte, TEST_CONTROL_PutByte, 0, 1 } } });
+	InitializeLinkSide(ssp_peer, &(ssp_init_str){ 0 });
+	for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = i; }
+	
+	const uint8_t record[] = { 1, 2, 3 };
+	TEST_ASSERT_TRUE(SPP_SendRecord(ssp, record, sizeof(record)));
+	test_loop_count = 10;
+	RunLink((HANDSHAKE_RETRIES + 1) * (TX_TIMEOUT + 1), true);
+	
+	// Plain legacy link then - records dropped, channel 0 only
+	TEST_ASSERT_TRUE(Cold_(ssp)->handshake.done);
+	TEST_ASSERT_TRUE(IsLegacyFrame(ssp));
+	TEST_ASSERT_FALSE(SPP_SendRecord(ssp, record, sizeof(record)));
+	
+	test_serial_to_tx_len = 100;
+	RunLink(2000, true);
+	TEST_ASSERT_EQUAL(0, test_serial_to_tx_len);
+	TEST_ASSERT_EQUAL_UINT8(100, test_serial_rxed_index);
+	for(uint8_t i = 0; i < 100; i++){ TEST_ASSERT_EQUAL_UINT8(i, test_serial_rxed_array[i]); }
+	TEST_ASSERT_EQUAL(10, test_loop_count);
+}
+
+void test_session(void)
+{
+	ssp_init_str config = { .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16,
+		.session = true, .keepalive = 200, .dead_timeout = 1000 };
+	
+	// Without timeout peer is never dead, with it alive after first frame
+	TEST_ASSERT_TRUE(SPP_IsPeerAlive(ssp));
+	InitializeLinkSide(ssp, &config);
+	InitializeLinkSide(ssp_peer, &config);
+	TEST_ASSERT_FALSE(SPP_IsPeerAlive(ssp));
+	for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = i; }
+	
+	// Resets exchanged first, data follows
+	test_serial_to_tx_len = 10;
+	RunLink(500, true);
+	TEST_ASSERT_TRUE(Cold_(ssp)->session.established);
+	TEST_ASSERT_TRUE(Cold_(ssp_peer)->session.established);
+	TEST_ASSERT_EQUAL_UINT8(10, test_serial_rxed_index);
+	TEST_ASSERT_EQUAL_UINT8(ID_MIN, ssp_peer->rx.last_received_id);
+	
+	// Restarted sender starts from ID_MIN again, no duplicate drop,
+	// no waiting for TX_TIMEOUT
+	InitializeLinkSide(ssp, &config);
+	test_serial_to_tx_len = 10;
+	RunLink(500, true);
+	TEST_ASSERT_EQUAL_UINT8(20, test_serial_rxed_index);
+	for(uint8_t i = 0; i < 20; i++){ TEST_ASSERT_EQUAL_UINT8(i, test_serial_rxed_array[i]); }
+	
+	// Keepalives hold idle link alive
+	RunLink(3000, true);
+	TEST_ASSERT_TRUE(SPP_IsPeerAlive(ssp));
+	TEST_ASSERT_TRUE(SPP_IsPeerAlive(ssp_peer));
+	
+	// Frame lost, receiver restarted - repeated on its reset at once
+	test_serial_to_tx_len = 10;
+	RunLink(1, false);
+	test_link_count[0] = 0;
+	InitializeLinkSide(ssp_peer, &config);
+	
+	RunLink(500, true);
+	TEST_ASSERT_EQUAL_UINT8(30, test_serial_rxed_index);
+	for(uint8_t i = 20; i < 30; i++){ TEST_ASSERT_EQUAL_UINT8(i, test_serial_rxed_array[i]); }
+	
+	// Silent peer declared dead, back on first frame
+	RunLink(1000, false);
+	TEST_ASSERT_FALSE(SPP_IsPeerAlive(ssp));
+	test_link_count[0] = 0;
+	RunLink(300, true);
+	TEST_ASSERT_TRUE(SPP_IsPeerAlive(ssp));
+}
+
+void test_bus(void)
+{
+	// Master 0 with node per slave, slave 1 gets serial data, 
+	// slave 2 sends control data to master
+	static ssp_str master_nodes[2];
+	static ssp_str slaves[2];
+	ssp_str* const nodes[2] = { &master_nodes[0], &master_nodes[1] };
+	ssp_master_str master = { nodes, 2, 0 };
+	
+	ssp_init_str config = ssp_config_structure;
+	config.framing = SSP_FRAMING_COBS;
+	config.check_type = SSP_CHECK_CRC16;
+	config.bus = true;
+	config.bus_timeout = 300;
+	config.UART_PutByte_ = TEST_BUS_PutByte;
+	
+	config.bus_master = true;
+	config.bus_address = 0;
+	config.UART_GetByte_ = TEST_BUS_0_GetByte;
+	config.bus_peer = 1;
+	config.INPUT_GetByte_ = TEST_SERIAL_GetByte;
+	config.OUTPUT_PutByte_ = TEST_LOOP_PutByte;
+	TEST_ASSERT_TRUE(InitializeLink(nodes[0], &config));
+	config.bus_peer = 2;
+	config.INPUT_GetByte_ = TEST_LOOP_GetByte;
+	config.OUTPUT_PutByte_ = TEST_CONTROL_PutByte;
+	TEST_ASSERT_TRUE(InitializeLink(nodes[1], &config));
+	
+	config.bus_master = false;
+	config.bus_peer = 0;
+	config.bus_address = 1;
+	config.UART_GetByte_ = TEST_BUS_1_GetByte;
+	config.INPUT_GetByte_ = TEST_LOOP_GetByte;
+	config.OUTPUT_PutByte_ = TEST_SERIAL_PutByte;
+	TEST_ASSERT_TRUE(InitializeLink(&slaves[0], &config));
+	config.bus_address = 2;
+	config.UART_GetByte_ = TEST_BUS_2_GetByte;
+	config.INPUT_GetByte_ = TEST_CONTROL_GetByte;
+	config.OUTPUT_PutByte_ = TEST_LOOP_PutByte;
+	TEST_ASSERT_TRUE(InitializeLink(&slaves[1], &config));
+	
+	for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = i; }
+	test_serial_to_tx_len = 100;
+	test_control_to_tx_len = 30;
+	
+	for(uint16_t i = 0; i < 3000; i++){
+		SPP_MasterHandler(&master);
+		SPP_Handler(&slaves[0]);
+		SPP_Handler(&slaves[1]);
+		
+		// Half duplex - one talker at a time
+		uint8_t talkers = (slaves[0].tx.counter < slaves[0].tx.size)
+						+ (slaves[1].tx.counter < slaves[1].tx.size)
+						+ (nodes[0]->tx.counter < nodes[0]->tx.size)
+						+ (nodes[1]->tx.counter < nodes[1]->tx.size);
+		TEST_ASSERT_LESS_OR_EQUAL(1, talkers);
+	}
+	
+	TEST_ASSERT_EQUAL(0, test_serial_to_tx_len);
+	TEST_ASSERT_EQUAL_UINT8(100, test_serial_rxed_index);
+	for(uint8_t i = 0; i < 100; i++){ TEST_ASSERT_EQUAL_UINT8(i, test_serial_rxed_array[i]); }
+	
+	TEST_ASSERT_EQUAL_UINT8(0, test_control_to_tx_len);
+	TEST_ASSERT_EQUAL_UINT8(30, test_control_rxed_index);
+	TEST_ASSERT_EQUAL_HEX8(0xC0 | 30, test_control_rxed_array[0]);
+	TEST_ASSERT_EQUAL_HEX8(0xC0 | 1, test_control_rxed_array[29]);
+	
+	// Frame for other node skipped without decoding and check
+	test_serial_to_tx_len = 10;
+	TEST_ASSERT_TRUE(CreateFrameIn(nodes[0]));
+	Block_(nodes[0], nodes[0]->tx.frame.data)[BUS_PREFIX_SIZE + 3] ^= 0x01;
+	test_bus_head[2] = test_bus_tail;
+	TEST_BUS_PutByte(END_MARKER);
+	for(uint8_t i = 0; i < nodes[0]->tx.frame.size; i++){ TEST_BUS_PutByte(Block_(nodes[0], nodes[0]->tx.frame.data)[i]); }
+	test_bus_head[1] = test_bus_head[2];
+	
+	ssp_rx_answer_enum answer = NOTHING_RECEIVED;
+	for(uint8_t i = 0; i <= nodes[0]->tx.frame.size; i++){ answer = ReceptionHandler_(&slaves[1]); }
+	TEST_ASSERT_EQUAL(NOTHING_RECEIVED, answer);
+	for(uint8_t i = 0; i <= nodes[0]->tx.frame.size; i++){ answer = ReceptionHandler_(&slaves[0]); }
+	TEST_ASSERT_EQUAL(BROKEN_RECEIVED, answer);
+	
+	// Silent slave loses its turn
+	master.current = 1;
+	Cold_(nodes[1])->bus.token = true;
+	for(uint16_t i = 0; i < 400; i++){ SPP_MasterHandler(&master); }
+	TEST_ASSERT_EQUAL_UINT8(0, master.current);
+}
+
+void test_dma(void)
+{
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16,
+		.UART_PutBlock_ = TEST_DMA_PutBlock, .UART_GetBlock_ = TEST_DMA_GetBlock,
+		.UART_ReleaseBlock_ = TEST_DMA_ReleaseBlock });
+	
+	for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = i; }
+	test_serial_to_tx_len = 200;
+	
+	// Frame N+1 encoded while engine still sends frame N
+	for(uint8_t i = 0; (i < 5) and not test_dma_tx_data; i++){ SPP_Handler(ssp); }
+	const uint8_t* sent = test_dma_tx_data;
+	TEST_ASSERT_NOT_NULL(sent);
+	for(uint8_t i = 0; i < 5; i++){ SPP_Handler(ssp); }
+	TEST_ASSERT_TRUE(ssp->tx.block_busy);
+	TEST_ASSERT_TRUE(ssp->tx.next_ready);
+	TEST_ASSERT_EQUAL_PTR(sent, test_dma_tx_data);
+	
+	// Engine finishes every third call
+	bool is_next_encoded = false;
+	for(uint16_t i = 0; i < 300; i++){
+		SPP_Handler(ssp);
+		if(ssp->tx.block_busy and ssp->tx.next_ready) { is_next_encoded = true; }
+		if(i % 3 == 2) { TEST_DMA_Complete(ssp); }
+	}
+	
+	TEST_ASSERT_TRUE(is_next_encoded);
+	TEST_ASSERT_EQUAL(0, test_serial_to_tx_len);
+	TEST_ASSERT_EQUAL_UINT8(200, test_serial_rxed_index);
+	for(uint8_t i = 0; i < 200; i++){ TEST_ASSERT_EQUAL_UINT8(i & 127, test_serial_rxed_array[i]); }
+	
+	// All received blocks handed back
+	TEST_ASSERT_GREATER_THAN(0, test_dma_rx_given);
+	TEST_ASSERT_EQUAL_UINT8(test_dma_rx_given, test_dma_rx_released);
+}
+
+void test_dma_priority(void)
+{
+	// Bulk on serial, urgent control
+	ssp_init_str config = { .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16,
+		.UART_PutBlock_ = TEST_DMA_PutBlock, .UART_GetBlock_ = TEST_DMA_GetBlock,
+		.UART_ReleaseBlock_ = TEST_DMA_ReleaseBlock,
+		.channels_count = 2, .channels = {
+			{ TEST_SERIAL_GetByte, TEST_SERIAL_PutByte, 1, 1 },
+			{ TEST_CONTROL_GetByte, TEST_CONTROL_PutByte, 0, 1 } } };
+	Initialize(&config);
+	for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = i; }
+	test_serial_to_tx_len = 200;
+	
+	// Control comes while bulk frame is encoded ahead
+	uint8_t taken = 0;
+	uint8_t delivered = 0;
+	for(uint16_t i = 0; i < 300; i++){
+		SPP_Handler(ssp);
+		if((taken == 0) and ssp->tx.block_busy and ssp->tx.next_ready){
+			taken = 200 - test_serial_to_tx_len;
+			test_control_to_tx_len = 3;
+		}
+		if((delivered == 0) and test_control_rxed_index) { delivered = test_serial_rxed_index; }
+		if(i % 3 == 2) { TEST_DMA_Complete(ssp); }
+	}
+	
+	// It goes before the encoded one, which follows it
+	TEST_ASSERT_GREATER_THAN(0, taken);
+	TEST_ASSERT_LESS_THAN(taken, delivered);
+	TEST_ASSERT_EQUAL_UINT8(3, test_control_rxed_index);
+	TEST_ASSERT_EQUAL_UINT8(200, test_serial_rxed_index);
+	for(uint8_t i = 0; i < 200; i++){ TEST_ASSERT_EQUAL_UINT8(i & 127, test_serial_rxed_array[i]); }
+	
+	// Byte transmit encodes nothing ahead
+	config.UART_PutBlock_ = NULL;
+	config.UART_GetBlock_ = NULL;
+	config.UART_ReleaseBlock_ = NULL;
+	config.UART_GetByte_ = TEST_LOOP_GetByte;
+	config.UART_PutByte_ = TEST_LOOP_PutByte;
+	Initialize(&config);
+	test_serial_to_tx_len = 100;
+	for(uint16_t i = 0; i < 300; i++){
+		SPP_Handler(ssp);
+		TEST_ASSERT_FALSE(ssp->tx.next_ready);
+	}
+	TEST_ASSERT_EQUAL(0, test_serial_to_tx_len);
+}
+
+void test_pool(void)
+{
+	static uint8_t blocks[6][POOL_BLOCK_SIZE];
+	static uint16_t next[6];
+	static ssp_pool_str pool;
+	TEST_ASSERT_TRUE(SPP_PoolInit(&pool, blocks, next, 6));
+	
+	ssp_init_str config = { .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16, .pool = &pool };
+	InitializeLinkSide(ssp, &config);
+	InitializeLinkSide(ssp_peer, &config);
+	for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = i; }
+	
+	// Idle links hold no buffers, all given back after transfer
+	TEST_ASSERT_EQUAL_UINT16(6, SPP_PoolAvailable(&pool));
+	test_serial_to_tx_len = 100;
+	RunLink(2000, true);
+	TEST_ASSERT_EQUAL_UINT8(100, test_serial_rxed_index);
+	for(uint8_t i = 0; i < 100; i++){ TEST_ASSERT_EQUAL_UINT8(i, test_serial_rxed_array[i]); }
+	TEST_ASSERT_EQUAL_UINT16(6, SPP_PoolAvailable(&pool));
+	
+	// Empty pool - input waits, link goes on when blocks are back
+	uint16_t taken[6];
+	for(uint8_t i = 0; i < 6; i++){ taken[i] = PoolTake_(&pool); TEST_ASSERT_NOT_EQUAL(POOL_NONE, taken[i]); }
+	TEST_ASSERT_EQUAL_UINT16(POOL_NONE, PoolTake_(&pool));
+	
+	test_serial_to_tx_len = 10;
+	RunLink(100, true);
+	TEST_ASSERT_EQUAL_UINT8(100, test_serial_rxed_index);
+	TEST_ASSERT_EQUAL(10, test_serial_to_tx_len);
+	
+	for(uint8_t i = 0; i < 6; i++){ PoolGive_(&pool, taken[i]); }
+	RunLink(2000, true);
+	TEST_ASSERT_EQUAL_UINT8(110, test_serial_rxed_index);
+	TEST_ASSERT_EQUAL_UINT16(6, SPP_PoolAvailable(&pool));
+	
+	// Callbacks and link settings taken from hub, not from link config
+	static ssp_hub_str hub;
+	ssp_init_str hub_config = WithTestCallbacks(&config);
+	hub_config.UART_GetByte_ = TEST_LINK_B_GetByte;
+	hub_config.UART_PutByte_ = TEST_LINK_B_PutByte;
+	hub_config.INPUT_GetByte_ = TEST_CONTROL_GetByte;
+	hub_config.OUTPUT_PutByte_ = TEST_SERIAL_PutByte;
+	TEST_ASSERT_TRUE(SPP_HubInit(&hub, &hub_config));
+	
+	config.hub = &hub;
+	config.UART_GetByte_ = NULL;
+	config.UART_PutByte_ = NULL;
+	config.framing = SSP_FRAMING_ESCAPE;
+	TEST_ASSERT_TRUE(InitializeLink(ssp_peer, &config));
+	TEST_ASSERT_EQUAL_PTR(&hub, ssp_peer->hub);
+	TEST_ASSERT_EQUAL(SSP_FRAMING_COBS, ssp_peer->framing);
+	
+	test_serial_to_tx_len = 10;
+	RunLink(2000, true);
+	TEST_ASSERT_EQUAL_UINT8(120, test_serial_rxed_index);
+	TEST_ASSERT_EQUAL_UINT16(6, SPP_PoolAvailable(&pool));
+	
+	// Session state is a block of its own, held for good
+	config.session = true;
+	TEST_ASSERT_TRUE(InitializeLink(ssp_peer, &config));
+	TEST_ASSERT_EQUAL_UINT16(5, SPP_PoolAvailable(&pool));
+	TEST_ASSERT_NOT_EQUAL(POOL_NONE, ssp_peer->cold);
+	
+	// Blocks must be aligned to hold it
+	TEST_ASSERT_FALSE(SPP_PoolInit(&pool, (uint8_t (*)[POOL_BLOCK_SIZE])&blocks[0][1], next, 5));
+}
+
+void test_queue(void)
+{
+	static uint8_t blocks[8][POOL_BLOCK_SIZE];
+	static uint16_t next[8];
+	static ssp_pool_str pool;
+	TEST_ASSERT_TRUE(SPP_PoolInit(&pool, blocks, next, 8));
+	
+	// Needs pool, compact link always has one
+	const uint8_t message[QUEUE_MESSAGE_MAX + 1] = { 0 };
+	#if SSP_COMPACT == 0
+	Initialize(&(ssp_init_str){ .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16, 
+		.aggregation = true, .aggregation_fill = 0, .aggregation_delay = 0, 
+		.OUTPUT_PutRecord_ = TEST_SERIAL_PutRecord });
+	TEST_ASSERT_FALSE(SPP_Enqueue(ssp, message, 4));
+	#endif
+	
+	ssp_init_str config = { .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16,
+		.aggregation = true, .OUTPUT_PutRecord_ = TEST_SERIAL_PutRecord, .pool = &pool };
+	InitializeLinkSide(ssp, &config);
+	InitializeLinkSide(ssp_peer, &config);
+	
+	TEST_ASSERT_FALSE(SPP_Enqueue(ssp, message, 0));
+	TEST_ASSERT_FALSE(SPP_Enqueue(ssp, message, QUEUE_MESSAGE_MAX + 1));
+	
+	// Record that never fits a frame is refused, not dropped later
+	TEST_ASSERT_FALSE(SPP_Enqueue(ssp, message, QUEUE_MESSAGE_MAX));
+	
+	// Messages of two rounds arrive in order, boundaries kept
+	const uint8_t first[] = { 1, 0xFF, 3 };
+	const uint8_t second[] = { 4, 5 };
+	const uint8_t third[] = { 6, 7, 8, 9 };
+	TEST_ASSERT_TRUE(SPP_Enqueue(ssp, first, sizeof(first)));
+	TEST_ASSERT_TRUE(SPP_Enqueue(ssp, second, sizeof(second)));
+	RunLink(1, false);
+	TEST_ASSERT_TRUE(SPP_Enqueue(ssp, third, sizeof(third)));
+	RunLink(500, true);
+	
+	const uint8_t expected[] = { 3, 1, 0xFF, 3, 2, 4, 5, 4, 6, 7, 8, 9 };
+	TEST_ASSERT_EQUAL_UINT8(3, test_records_count);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, test_serial_rxed_array, sizeof(expected));
+	TEST_ASSERT_EQUAL_UINT16(8, SPP_PoolAvailable(&pool));
+	
+	// Reserve kept for frames, queued ones are not lost
+	uint8_t count = 0;
+	while(SPP_Enqueue(ssp, second, sizeof(second))) { count++; }
+	TEST_ASSERT_EQUAL_UINT8(8 - QUEUE_POOL_RESERVE, count);
+	RunLink(500, true);
+	TEST_ASSERT_EQUAL_UINT8(3 + count, test_records_count);
+	TEST_ASSERT_EQUAL_UINT16(8, SPP_PoolAvailable(&pool));
+	
+	// Escaping counted for escaped link
+	uint8_t collisions[30];
+	memset(collisions, COLLISION_SYMBOL, sizeof(collisions));
+	config.framing = SSP_FRAMING_ESCAPE;
+	InitializeLinkSide(ssp, &config);
+	TEST_ASSERT_FALSE(SPP_Enqueue(ssp, collisions, 30));
+	TEST_ASSERT_TRUE(SPP_Enqueue(ssp, collisions, 27));
+	TEST_ASSERT_TRUE(SPP_Enqueue(ssp, message, 50));
+}
+
+void test_split_handlers(void)
+{
+	ssp_init_str config = { .framing = SSP_FRAMING_COBS, .check_type = SSP_CHECK_CRC16, .flow_control = true };
+	InitializeLinkSide(ssp, &config);
+	InitializeLinkSide(ssp_peer, &config);
+	
+	for(uint8_t i = 0; i < 128; i++){ test_serial_to_tx_array[i] = i; }
+	test_serial_to_tx_len = 250;
+	
+	// Receiver half only posts ACK, transmitter half sends it
+	SPP_TxHandler(ssp);
+	SPP_TxHandler(ssp);
+	for(uint16_t i = 0; (i < 255) and not IsAckRequested_(ssp_peer); i++){ SPP_RxHandler(ssp_peer); }
+	TEST_ASSERT_TRUE(IsAckRequested_(ssp_peer));
+	TEST_ASSERT_EQUAL_UINT16(0, test_link_count[1]);
+	
+	SPP_TxHandler(ssp_peer);
+	SPP_TxHandler(ssp_peer);
+	TEST_ASSERT_FALSE(IsAckRequested_(ssp_peer));
+	TEST_ASSERT_GREATER_THAN(0, test_link_count[1]);
+	
+	// Halves called at own pace, nothing lost or repeated
+	for(uint16_t i = 0; i < 3000; i++){
+		SPP_TxHandler(ssp);
+		if(i % 3 == 0) { SPP_RxHandler(ssp); }
+		SPP_RxHandler(ssp_peer);
+		if(i % 2 == 0) { SPP_TxHandler(ssp_peer); }
+	}
+	
+	TEST_ASSERT_EQUAL_UINT16(0, test_serial_to_tx_len);
+	TEST_ASSERT_EQUAL_UINT16(250, test_serial_rxed_index);
+	for(uint16_t i = 0; i < 250; i++){
+		TEST_ASSERT_EQUAL_UINT8(i & 127, test_serial_rxed_array[i]);
+	}
 }
 
 int main(void)
@@ -86,6 +1154,38 @@ int main(void)
 	RUN_TEST(test_send_ack);
 	
 	RUN_TEST(test_reception);
+	
+	RUN_TEST(test_cobs_worst_case);
+	RUN_TEST(test_damaged_end);
+	RUN_TEST(test_cobs_reception);
+	
+	RUN_TEST(test_check_vectors);
+	RUN_TEST(test_check_reception);
+	
+	RUN_TEST(test_fec_correction);
+	
+	RUN_TEST(test_compression);
+	RUN_TEST(test_compression_reception);
+	
+	RUN_TEST(test_aggregation);
+	RUN_TEST(test_aggregation_policy);
+	
+	RUN_TEST(test_channels_priority);
+	RUN_TEST(test_channels_weight);
+	RUN_TEST(test_channels_unknown);
+	
+	RUN_TEST(test_flow_control);
+	RUN_TEST(test_pacing);
+	RUN_TEST(test_handshake);
+	RUN_TEST(test_handshake_fallback);
+	RUN_TEST(test_handshake_legacy);
+	RUN_TEST(test_session);
+	RUN_TEST(test_bus);
+	RUN_TEST(test_dma);
+	RUN_TEST(test_dma_priority);
+	RUN_TEST(test_pool);
+	RUN_TEST(test_queue);
+	RUN_TEST(test_split_handlers);
 
 	return UNITY_END();
 }
@@ -161,7 +1261,7 @@ void test_setup_transmitter_frame(void)
 	// Preinit ssp
 	ssp->tx.timeout = 255;
 	ssp->tx.counter = 255;
-	ssp->tx.data = NULL;
+	ssp->tx.data = POOL_NONE;
 	ssp->tx.size = 255;
 	
 	// ACK Creation
@@ -171,7 +1271,7 @@ void test_setup_transmitter_frame(void)
 	SetupTransmitterForFrame_(ssp);
 	
 	// Check results
-	TEST_ASSERT_EQUAL_PTR(ssp->tx.frame.data,		ssp->tx.data);
+	TEST_ASSERT_EQUAL_UINT16(ssp->tx.frame.data,	ssp->tx.data);
 	TEST_ASSERT_EQUAL_UINT8(ssp->tx.frame.size,		ssp->tx.size);
 	TEST_ASSERT_EQUAL_UINT8(0,						ssp->tx.counter);
 	TEST_ASSERT_EQUAL_UINT8(0,						ssp->tx.timeout);
@@ -207,14 +1307,14 @@ void test_setup_transmitter_ack(void)
 	SetupTransmitterForAck_(ssp);
 	
 	// Check results
-	TEST_ASSERT_EQUAL_PTR(&ssp->tx.ack,				ssp->tx.data);
+	TEST_ASSERT_EQUAL_UINT16(ssp->tx.ack.data,		ssp->tx.data);
 	TEST_ASSERT_EQUAL_UINT8(expected_header.size,	ssp->tx.size);
 	TEST_ASSERT_EQUAL_UINT8(0,						ssp->tx.counter);
 	
-	TEST_ASSERT_EQUAL_UINT8(expected_header.size,	ssp->tx.data[SIZE_INDEX]);
-	TEST_ASSERT_EQUAL_UINT8(expected_header.id,		ssp->tx.data[ID_INDEX]);
-	TEST_ASSERT_EQUAL_UINT8(expected_header.crc8,	ssp->tx.data[CRC8_INDEX]);
-	TEST_ASSERT_EQUAL_UINT8(END_MARKER,				ssp->tx.data[END_INDEX]);
+	TEST_ASSERT_EQUAL_UINT8(expected_header.size,	Block_(ssp, ssp->tx.data)[SIZE_INDEX]);
+	TEST_ASSERT_EQUAL_UINT8(expected_header.id,		Block_(ssp, ssp->tx.data)[ID_INDEX]);
+	TEST_ASSERT_EQUAL_UINT8(expected_header.crc8,	Block_(ssp, ssp->tx.data)[CRC8_INDEX]);
+	TEST_ASSERT_EQUAL_UINT8(END_MARKER,				Block_(ssp, ssp->tx.data)[END_INDEX]);
 }
 
 void test_generate_id(void)
@@ -253,14 +1353,21 @@ void test_create_ack(void)
 	// CRC8 Collision handling
 	if(expected_header.crc8 == END_MARKER) { expected_header.crc8 = COLLISION_MARKER; }
 	
+	const uint8_t SIZE_INDEX = 0;
+	const uint8_t ID_INDEX = SIZE_INDEX + 1;
+	const uint8_t CRC8_INDEX = SIZE_INDEX + 2;
+	const uint8_t END_INDEX = SIZE_INDEX + 3;
+	
 	// TEST
 	CreateAck_(ssp, generated_id);
 	
 	// Check results
-	TEST_ASSERT_EQUAL_UINT8(expected_header.size,	ssp->tx.ack.size);
+	TEST_ASSERT_EQUAL_UINT8(HEADER_SIZE,			ssp->tx.ack.size);
 	TEST_ASSERT_EQUAL_UINT8(expected_header.id,		ssp->tx.ack.id);
-	TEST_ASSERT_EQUAL_UINT8(expected_header.crc8,	ssp->tx.ack.crc8);
-	TEST_ASSERT_EQUAL_UINT8(END_MARKER,				ssp->tx.ack.end);
+	TEST_ASSERT_EQUAL_UINT8(expected_header.size,	Block_(ssp, ssp->tx.ack.data)[SIZE_INDEX]);
+	TEST_ASSERT_EQUAL_UINT8(expected_header.id,		Block_(ssp, ssp->tx.ack.data)[ID_INDEX]);
+	TEST_ASSERT_EQUAL_UINT8(expected_header.crc8,	Block_(ssp, ssp->tx.ack.data)[CRC8_INDEX]);
+	TEST_ASSERT_EQUAL_UINT8(END_MARKER,				Block_(ssp, ssp->tx.ack.data)[END_INDEX]);
 }
 
 void test_create_frame(void){
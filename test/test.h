@@ -106,6 +106,164 @@ static bool TEST_SERIAL_PutByte(uint8_t value){
 	else { return false; }
 };
 
+static uint8_t test_records_count;
+static uint8_t test_records_refused;
+
+static bool TEST_SERIAL_PutRecord(const uint8_t* data, uint8_t size){
+	if(test_records_refused > 0) { test_records_refused--; return false; }
+	if(test_serial_rxed_len < (size_t)size + 1) { return false; }
+	
+	// Stored with size prefix to check boundaries
+	test_serial_rxed_array[test_serial_rxed_index++] = size;
+	memcpy(&test_serial_rxed_array[test_serial_rxed_index], data, size);
+	test_serial_rxed_index += size;
+	test_serial_rxed_len -= size + 1;
+	test_records_count++;
+	return true;
+};
+
+static uint8_t test_control_to_tx_len;
+static uint8_t test_control_rxed_index;
+static uint8_t test_control_rxed_array[256];
+
+static bool TEST_CONTROL_GetByte(uint8_t* value){
+	if(test_control_to_tx_len > 0){
+		*value = 0xC0 | test_control_to_tx_len;
+		test_control_to_tx_len--;
+		return true;
+	}
+	else { return false; }
+};
+
+static bool TEST_CONTROL_PutByte(uint8_t value){
+	test_control_rxed_array[test_control_rxed_index++] = value;
+	return true;
+};
+
+static uint8_t test_loop_array[256];
+static uint8_t test_loop_head;
+static uint16_t test_loop_count;
+
+static bool TEST_LOOP_GetByte(uint8_t* value){
+	if(test_loop_count > 0){
+		*value = test_loop_array[test_loop_head++];
+		test_loop_count--;
+		return true;
+	}
+	else { return false; }
+};
+
+static bool TEST_LOOP_PutByte(uint8_t value){
+	if(test_loop_count < sizeof(test_loop_array)){
+		test_loop_array[(uint8_t)(test_loop_head + test_loop_count)] = value;
+		test_loop_count++;
+		return true;
+	}
+	else { return false; }
+};
+
+// Two ring link, A puts to 0 and gets from 1, B the other way
+static uint8_t test_link_array[2][256];
+static uint8_t test_link_head[2];
+static uint16_t test_link_count[2];
+
+static bool TEST_LinkGet(uint8_t ring, uint8_t* value){
+	if(test_link_count[ring] > 0){
+		*value = test_link_array[ring][test_link_head[ring]++];
+		test_link_count[ring]--;
+		return true;
+	}
+	else { return false; }
+};
+
+static bool TEST_LinkPut(uint8_t ring, uint8_t value){
+	if(test_link_count[ring] < sizeof(test_link_array[ring])){
+		test_link_array[ring][(uint8_t)(test_link_head[ring] + test_link_count[ring])] = value;
+		test_link_count[ring]++;
+		return true;
+	}
+	else { return false; }
+};
+
+static bool TEST_LINK_A_GetByte(uint8_t* value){ return TEST_LinkGet(1, value); };
+static bool TEST_LINK_A_PutByte(uint8_t value){ return TEST_LinkPut(0, value); };
+static bool TEST_LINK_B_GetByte(uint8_t* value){ return TEST_LinkGet(0, value); };
+static bool TEST_LINK_B_PutByte(uint8_t value){ return TEST_LinkPut(1, value); };
+
+// Shared bus, every node hears every byte, own ones as well
+#define TEST_BUS_NODES	(3)
+static uint8_t test_bus_array[1024];
+static uint16_t test_bus_tail;
+static uint16_t test_bus_head[TEST_BUS_NODES];
+
+static bool TEST_BusGet(uint8_t node, uint8_t* value){
+	if(test_bus_head[node] != test_bus_tail){
+		*value = test_bus_array[test_bus_head[node]++ & 1023];
+		return true;
+	}
+	else { return false; }
+};
+
+static bool TEST_BUS_PutByte(uint8_t value){
+	test_bus_array[test_bus_tail++ & 1023] = value;
+	return true;
+};
+
+static bool TEST_BUS_0_GetByte(uint8_t* value){ return TEST_BusGet(0, value); };
+static bool TEST_BUS_1_GetByte(uint8_t* value){ return TEST_BusGet(1, value); };
+static bool TEST_BUS_2_GetByte(uint8_t* value){ return TEST_BusGet(2, value); };
+
+// DMA engine, block goes to loop ring on completion
+static const uint8_t* test_dma_tx_data;
+static uint8_t test_dma_tx_size;
+static uint8_t test_dma_tx_copy[256];
+static uint8_t test_dma_rx_buffer[2][16];
+static uint8_t test_dma_rx_turn;
+static uint8_t test_dma_rx_given;
+static uint8_t test_dma_rx_released;
+
+static bool TEST_DMA_PutBlock(const uint8_t* data, uint8_t size){
+	if(test_dma_tx_data) { return false; }
+	test_dma_tx_data = data;
+	test_dma_tx_size = size;
+	memcpy(test_dma_tx_copy, data, size);
+	return true;
+};
+
+static void TEST_DMA_Complete(ssp_str* side){
+	if(test_dma_tx_data == NULL) { return; }
+	
+	// Buffer untouched while in flight
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(test_dma_tx_copy, test_dma_tx_data, test_dma_tx_size);
+	for(uint8_t i = 0; i < test_dma_tx_size; i++){ TEST_LOOP_PutByte(test_dma_tx_data[i]); }
+	
+	test_dma_tx_data = NULL;
+	SPP_TransmitComplete(side);
+};
+
+static const uint8_t* TEST_DMA_GetBlock(uint8_t* size){
+	uint8_t* buffer = test_dma_rx_buffer[test_dma_rx_turn];
+	uint8_t filled = 0;
+	while((filled < sizeof(test_dma_rx_buffer[0])) and TEST_LOOP_GetByte(&buffer[filled])) { filled++; }
+	if(filled == 0) { return NULL; }
+	
+	test_dma_rx_turn ^= 1;
+	test_dma_rx_given++;
+	*size = filled;
+	return buffer;
+};
+
+static void TEST_DMA_ReleaseBlock(const uint8_t* data){
+	TEST_ASSERT_EQUAL_PTR(test_dma_rx_buffer[test_dma_rx_turn ^ 1], data);
+	test_dma_rx_released++;
+};
+
+static uint32_t test_time_us;
+
+static uint32_t TEST_TIME_GetMicros(void){
+	return test_time_us;
+};
+
 static uint8_t TEST_HELPER_DallasCRC8_P(const uint8_t* data, const uint8_t size)
 {
     uint8_t crc = 0;
@@ -133,20 +291,57 @@ static uint8_t TEST_HELPER_DallasCRC8_(uint8_t inbyte, uint8_t crc)
 }
 
 static const ssp_init_str ssp_config_structure = {
-	TEST_HELPER_DallasCRC8_,
-	TEST_UART_GetByte,
-	TEST_UART_PutByte,
-	TEST_SERIAL_GetByte,
-	TEST_SERIAL_PutByte,
+	.CRC8_Function = TEST_HELPER_DallasCRC8_,
+	.UART_GetByte_ = TEST_UART_GetByte,
+	.UART_PutByte_ = TEST_UART_PutByte,
+	.INPUT_GetByte_ = TEST_SERIAL_GetByte,
+	.OUTPUT_PutByte_ = TEST_SERIAL_PutByte,
 };
 	
 ssp_str ssp_object = { 0 };
 ssp_str* const ssp = &ssp_object;
+
+// Other end of the link, serial data flows from ssp to it
+ssp_str ssp_peer_object = { 0 };
+ssp_str* const ssp_peer = &ssp_peer_object;
 	
 static const ssp_init_str* const ssp_config = &ssp_config_structure;
 
+#if SSP_COMPACT
+// Compact link has no own hub and buffers, tests give it theirs
+#define TEST_HUBS_MAX		(16)
+#define TEST_HUB_BLOCKS		(32)
+
+static ssp_hub_str test_hubs[TEST_HUBS_MAX];
+static uint8_t test_hubs_count;
+static uint8_t test_hub_blocks[TEST_HUB_BLOCKS][POOL_BLOCK_SIZE];
+static uint16_t test_hub_next[TEST_HUB_BLOCKS];
+static ssp_pool_str test_hub_pool;
+#endif
+
+bool InitializeLink(ssp_str* link, const ssp_init_str* config)
+{
+	#if SSP_COMPACT
+	ssp_init_str compact = *config;
+	if(not compact.pool) { compact.pool = &test_hub_pool; }
+	if(not compact.hub){
+		if((test_hubs_count == TEST_HUBS_MAX) 
+		or not SPP_HubInit(&test_hubs[test_hubs_count], config)) { return false; }
+		compact.hub = &test_hubs[test_hubs_count++];
+	}
+	return SPP_Init(link, &compact);
+	#else
+	return SPP_Init(link, config);
+	#endif
+}
+
 void setUp (void) 
 { 
+	#if SSP_COMPACT
+	test_hubs_count = 0;
+	SPP_PoolInit(&test_hub_pool, test_hub_blocks, test_hub_next, TEST_HUB_BLOCKS);
+	#endif
+	
 	test_uart_rxed_index = 0;
 	test_uart_txed_index = 0;
 	test_uart_len = 4096;
@@ -157,14 +352,35 @@ void setUp (void)
 	test_serial_to_tx_index = 0;
 	test_serial_rxed_len = 4096;
 	test_serial_to_tx_len = 0;
+	test_records_count = 0;
+	test_records_refused = 0;
+	test_control_to_tx_len = 0;
+	test_control_rxed_index = 0;
+	test_loop_head = 0;
+	test_loop_count = 0;
+	test_time_us = 0;
+	memset(test_link_head, 0, sizeof(test_link_head));
+	memset(test_bus_head, 0, sizeof(test_bus_head));
+	test_bus_tail = 0;
+	test_dma_tx_data = NULL;
+	test_dma_rx_turn = 0;
+	test_dma_rx_given = 0;
+	test_dma_rx_released = 0;
+	memset(test_link_count, 0, sizeof(test_link_count));
 	
 	memset(test_serial_rxed_array, 0, 4096);
 
-	TEST_ASSERT_TRUE(SPP_Init(ssp, ssp_config)); 
+	TEST_ASSERT_TRUE(InitializeLink(ssp, ssp_config));
 }
 
 void tearDown (void) {} /* Is run after every test, put unit clean-up calls here. */
 
+// Frame buffer taken as PrepareFrame_ does, compact links have none
+bool CreateFrameIn(ssp_str* link)
+{
+	return TakeBlock_(link, &link->tx.frame.data) and CreateFrame_(link);
+}
+
 uint8_t GetCollisionsCount(uint8_t* arr, uint8_t size)
 {
 	uint8_t col = 0;
@@ -228,21 +444,21 @@ void CreateFrameWithSize(uint8_t payload_size, bool ex_result)
 	const uint8_t END_INDEX = ex_header_size + 3;
 
 	// TEST
-	bool result = CreateFrame_(ssp);
+	bool result = CreateFrameIn(ssp);
 
 	// Check results
 	if(ex_result){
 		// Range, because size also depend on collisions count.
-		TEST_ASSERT_GREATER_OR_EQUAL_UINT8(ex_header_size - 1,	ssp->tx.frame.data[SIZE_INDEX]);
-		TEST_ASSERT_LESS_OR_EQUAL_UINT8(ex_header_size,			ssp->tx.frame.data[SIZE_INDEX]);
+		TEST_ASSERT_GREATER_OR_EQUAL_UINT8(ex_header_size - 1,	Block_(ssp, ssp->tx.frame.data)[SIZE_INDEX]);
+		TEST_ASSERT_LESS_OR_EQUAL_UINT8(ex_header_size,			Block_(ssp, ssp->tx.frame.data)[SIZE_INDEX]);
 		TEST_ASSERT_GREATER_OR_EQUAL_UINT8(ex_total_size - 1,	ssp->tx.frame.size);
 		TEST_ASSERT_LESS_OR_EQUAL_UINT8(ex_total_size,			ssp->tx.frame.size);
 		
 		TEST_ASSERT_TRUE(result);
-		TEST_ASSERT_EQUAL_HEX8(ex_crc8,		ssp->tx.frame.data[CRC8_INDEX]);
+		TEST_ASSERT_EQUAL_HEX8(ex_crc8,		Block_(ssp, ssp->tx.frame.data)[CRC8_INDEX]);
 		TEST_ASSERT_EQUAL_UINT8(ex_id,		ssp->tx.frame.id);
-		TEST_ASSERT_EQUAL_UINT8(ex_id,		ssp->tx.frame.data[ID_INDEX]);
-		TEST_ASSERT_EQUAL_UINT8(END_MARKER,	ssp->tx.frame.data[END_INDEX]);
+		TEST_ASSERT_EQUAL_UINT8(ex_id,		Block_(ssp, ssp->tx.frame.data)[ID_INDEX]);
+		TEST_ASSERT_EQUAL_UINT8(END_MARKER,	Block_(ssp, ssp->tx.frame.data)[END_INDEX]);
 	
 	}
 	else {
@@ -250,9 +466,79 @@ void CreateFrameWithSize(uint8_t payload_size, bool ex_result)
 	}
 }
 
+ssp_rx_answer_enum ReceiveAll(void)
+{
+	ssp_rx_answer_enum answer = NOTHING_RECEIVED;
+	for(uint16_t i = 0; i < 1024; i++){
+		answer = ReceptionHandler_(ssp);
+		if(answer != NOTHING_RECEIVED) { break; }
+	}
+	return answer;
+}
+
+// Test callbacks for whatever config leaves NULL
+ssp_init_str WithTestCallbacks(const ssp_init_str* config)
+{
+	ssp_init_str full = *config;
+	if(not full.CRC8_Function) { full.CRC8_Function = TEST_HELPER_DallasCRC8_; }
+	if(not full.UART_GetByte_ and not full.UART_GetBlock_) { full.UART_GetByte_ = TEST_UART_GetByte; }
+	if(not full.UART_PutByte_ and not full.UART_PutBlock_) { full.UART_PutByte_ = TEST_UART_PutByte; }
+	if(not full.INPUT_GetByte_) { full.INPUT_GetByte_ = TEST_SERIAL_GetByte; }
+	if(not full.OUTPUT_PutByte_) { full.OUTPUT_PutByte_ = TEST_SERIAL_PutByte; }
+	return full;
+}
+
+void Initialize(const ssp_init_str* config)
+{
+	ssp_init_str full = WithTestCallbacks(config);
+	TEST_ASSERT_TRUE(InitializeLink(ssp, &full));
+}
+
+void InitializeLinkSide(ssp_str* side, const ssp_init_str* config)
+{
+	ssp_init_str side_config = WithTestCallbacks(config);
+	
+	if(side == ssp){
+		side_config.UART_GetByte_ = TEST_LINK_A_GetByte;
+		side_config.UART_PutByte_ = TEST_LINK_A_PutByte;
+		side_config.INPUT_GetByte_ = TEST_SERIAL_GetByte;
+		side_config.OUTPUT_PutByte_ = TEST_CONTROL_PutByte;
+	}
+	else {
+		side_config.UART_GetByte_ = TEST_LINK_B_GetByte;
+		side_config.UART_PutByte_ = TEST_LINK_B_PutByte;
+		side_config.INPUT_GetByte_ = TEST_CONTROL_GetByte;
+		side_config.OUTPUT_PutByte_ = TEST_SERIAL_PutByte;
+	}
+	TEST_ASSERT_TRUE(InitializeLink(side, &side_config));
+}
+
+void RunLink(uint16_t calls, bool is_peer_running)
+{
+	for(uint16_t i = 0; i < calls; i++){
+		SPP_Handler(ssp);
+		if(is_peer_running) { SPP_Handler(ssp_peer); }
+	}
+}
+
+void RunLoopback(const uint8_t* source, uint8_t size)
+{
+	memcpy(test_serial_to_tx_array, source, size);
+	test_serial_to_tx_len = size;
+	
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_TRUE(TransmissionHandler_(ssp));
+	TEST_ASSERT_EQUAL_UINT8(0, test_serial_to_tx_len);
+	
+	TEST_ASSERT_EQUAL(FRAME_RECEIVED, ReceiveAll());
+	TEST_ASSERT_TRUE(PushAllReceivedData(ssp));
+	TEST_ASSERT_EQUAL_UINT8(size, test_serial_rxed_index);
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(source, test_serial_rxed_array, size);
+}
+
 void InitializeTransmitterWithRandomValues(void){
 	ssp->tx.counter = 225;
-	ssp->tx.data = (void*)0xFF98AA43;
+	ssp->tx.data = 0xAA43;
 	ssp->tx.size = 235;
 }
 